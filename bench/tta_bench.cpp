@@ -0,0 +1,501 @@
+/*
+ * tta_bench.cpp
+ *
+ * Description: TTA codec microbenchmarks
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+// The benchmarks time the hot parts of the codec one by one, so the
+// library is built into this program as a whole: the filter kernels,
+// the bit reader and writer and the PCM passes are internal to it.
+#include "../libtta.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(CPU_X86)
+#if defined(__GNUC__)
+#include <x86intrin.h>
+#else // MSVC
+#include <intrin.h>
+#endif
+#endif
+
+using namespace tta;
+
+//////////////////////// Constants and definitions //////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_RATE 44100 // sample rate of the signals
+#define BENCH_SAMPLES (BENCH_RATE * 4) // length of the signals
+#define BENCH_CRC_SIZE (1 << 20) // crc buffer size
+#define BENCH_TIME 0.2 // default time of a benchmark (s)
+
+enum signal_type { SILENCE, NOISE, SINE, REAL, SIGNALS };
+
+static const char *signal_names[SIGNALS] = { "silence", "noise", "sine", "real" };
+static const uint32_t bench_depths[] = { 2, 3 };
+static const uint32_t bench_channels[] = { 1, 2, 6 };
+
+static double bench_time = BENCH_TIME;
+static const char *bench_filter = nullptr;
+
+////////////////////////////// Timing helpers ///////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+static __inline uint64_t bench_cycles() {
+#if defined(CPU_X86)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+} // bench_cycles
+
+static bool bench_selected(const char *group) {
+	return !bench_filter || strstr(group, bench_filter);
+} // bench_selected
+
+// runs 'run' repeatedly for the benchmark time, each run passes 'units'
+// units (samples or bytes); prints the rate, the cycles per unit and
+// the speedup against the rate 'base' if given, returns the rate
+template<typename F>
+static double bench_run(const char *group, const char *variant,
+	const char *signal, uint32_t nch, uint32_t bits, const char *unit,
+	uint64_t units, F run, double base = 0) {
+	std::chrono::steady_clock::time_point start, end;
+	uint64_t cycles, count = 0;
+	double elapsed, rate;
+
+	run(); // warm-up
+
+	start = std::chrono::steady_clock::now();
+	cycles = bench_cycles();
+	do {
+		run();
+		count++;
+		end = std::chrono::steady_clock::now();
+		elapsed = std::chrono::duration<double>(end - start).count();
+	} while (elapsed < bench_time);
+	cycles = bench_cycles() - cycles;
+	rate = (double)(units * count) / elapsed;
+
+	printf("%-12s %-14s %-8s %3u %5u %10.2f ", group, variant, signal,
+		nch, bits, rate / 1e6);
+	if (cycles) printf("%9.2f", (double) cycles / (double)(units * count));
+	else printf("%9s", "-");
+	printf("  %s", unit);
+	if (base) printf("  %.2fx", rate / base);
+	printf("\n");
+	fflush(stdout);
+
+	return rate;
+} // bench_run
+
+/////////////////////////////// Test signals ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// 'count' samples of 'nch' channels of the signal in the range of the
+// depth, interleaved
+static std::vector<int32_t> make_signal(signal_type type, uint32_t nch,
+	uint32_t depth, uint32_t count) {
+	std::vector<int32_t> out((size_t) count * nch);
+	std::mt19937 rng(12345);
+	double peak = (double)((1 << (depth * 8 - 1)) - 1);
+	std::vector<double> lp(nch);
+	uint32_t i, ch;
+
+	for (i = 0; i < count; i++) {
+		for (ch = 0; ch < nch; ch++) {
+			double t = (double) i / BENCH_RATE, x = 0;
+			double u = (double) rng() / 4294967296.0 * 2.0 - 1.0;
+
+			switch (type) {
+			case SILENCE: x = 0; break;
+			case NOISE: x = u; break;
+			case SINE: x = 0.5 * sin(2 * M_PI * (440.0 + 110.0 * ch) * t); break;
+			case REAL:
+				// a few partials over low-passed noise, like music
+				lp[ch] = 0.97 * lp[ch] + 0.03 * u;
+				x = 0.3 * sin(2 * M_PI * 220.0 * t + ch) +
+					0.15 * sin(2 * M_PI * 660.0 * t) +
+					0.05 * sin(2 * M_PI * 3520.0 * t) + 2.0 * lp[ch];
+				break;
+			default: break;
+			}
+			if (x > 1) x = 1;
+			if (x < -1) x = -1;
+			out[(size_t) i * nch + ch] = (int32_t) lrint(x * peak);
+		}
+	}
+
+	return out;
+} // make_signal
+
+static std::vector<uint8_t> make_pcm(const std::vector<int32_t> &values,
+	uint32_t depth) {
+	std::vector<uint8_t> out(values.size() * depth + 32);
+	uint8_t *p = out.data();
+
+	for (int32_t v : values)
+		for (uint32_t b = 0; b < depth; b++)
+			*p++ = (uint8_t)(v >> (b * 8));
+
+	return out;
+} // make_pcm
+
+static const char *arch_name(cpu_arch arch) {
+	switch (arch) {
+	case cpu_arch::UNKNOWN: return "compat";
+	case cpu_arch::PORTABLE_SIMD: return "vector";
+	case cpu_arch::IX86_SSE2: return "sse2";
+	case cpu_arch::IX86_SSE3: return "sse3";
+	case cpu_arch::IX86_SSE4_1: return "sse4.1";
+	case cpu_arch::IX86_SSE4_2: return "sse4.2";
+	case cpu_arch::IX86_AVX: return "avx2";
+	case cpu_arch::IX86_AVX512: return "avx512";
+	case cpu_arch::ARM: return "arm";
+	case cpu_arch::AARCH64: return "aarch64";
+	}
+	return "?";
+} // arch_name
+
+////////////////////////////// Hybrid filters ///////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// a column of one channel and TTA_LANES interleaved channels through
+// every kernel set the cpu runs, against the compat kernels; the
+// decoder input is the encoder output, the output of each set must
+// match the one of the compat kernels
+static void bench_filters() {
+	const uint32_t count = BENCH_SAMPLES;
+
+	if (!bench_selected("filter") && !bench_selected("lanes")) return;
+
+	for (uint32_t depth : bench_depths)
+	for (int s = 0; s < SIGNALS; s++) {
+		int32_t shift = flt_set[depth - 1];
+		std::vector<int32_t> pcm = make_signal((signal_type) s, 1, depth, count);
+		std::vector<int32_t> lanes = make_signal((signal_type) s, TTA_LANES, depth, count);
+		std::vector<int32_t> res(pcm.size()), lres(lanes.size()), buf(lanes.size());
+		std::unique_ptr<codec_state> codec(new codec_state);
+		std::unique_ptr<codec_lanes> fs(new codec_lanes);
+		double base[4] = {0, 0, 0, 0}; // rates of the compat kernels
+
+		auto lanes_init = [&]() {
+			for (uint32_t n = 0; n < TTA_LANES; n++)
+				hybrid_filter_lanes_init(fs.get(), n, 0, shift);
+		};
+
+		auto check = [&](const char *group, const char *name,
+			const std::vector<int32_t> &ref) {
+			if (memcmp(buf.data(), ref.data(), ref.size() * sizeof(int32_t)))
+				fprintf(stderr, "%s: %s %s %u bits: mismatch\n",
+					group, name, signal_names[s], depth * 8);
+		};
+
+		// the residuals of the signal, for the decoders
+		res = pcm;
+		codec->init(0, shift, 10, 10);
+		codec->encode(filter_kernel_sets[0], res.data(), count, 1);
+		lres = lanes;
+		lanes_init();
+		filter_kernel_sets[0]->lanes_enc(fs.get(), lres.data(), count, TTA_LANES);
+
+		for (const TTA_kernels *ks : filter_kernel_sets) {
+			const char *name = arch_name(ks->arch);
+			double rate[4];
+
+			if (filter_kernels_find(ks->arch) == nullptr) continue;
+
+			rate[0] = bench_run("filter.dec", name, signal_names[s], 1, depth * 8, "smp", count, [&]() {
+				tta_memcpy(buf.data(), res.data(), count * sizeof(int32_t));
+				codec->init(0, shift, 10, 10);
+				codec->decode(ks, buf.data(), count, 1);
+			}, base[0]);
+			check("filter.dec", name, pcm);
+			rate[1] = bench_run("filter.enc", name, signal_names[s], 1, depth * 8, "smp", count, [&]() {
+				tta_memcpy(buf.data(), pcm.data(), count * sizeof(int32_t));
+				codec->init(0, shift, 10, 10);
+				codec->encode(ks, buf.data(), count, 1);
+			}, base[1]);
+			check("filter.enc", name, res);
+			rate[2] = bench_run("lanes.dec", name, signal_names[s], TTA_LANES, depth * 8, "smp",
+				(uint64_t) count * TTA_LANES, [&]() {
+				tta_memcpy(buf.data(), lres.data(), lres.size() * sizeof(int32_t));
+				lanes_init();
+				ks->lanes_dec(fs.get(), buf.data(), count, TTA_LANES);
+			}, base[2]);
+			check("lanes.dec", name, lanes);
+			rate[3] = bench_run("lanes.enc", name, signal_names[s], TTA_LANES, depth * 8, "smp",
+				(uint64_t) count * TTA_LANES, [&]() {
+				tta_memcpy(buf.data(), lanes.data(), lanes.size() * sizeof(int32_t));
+				lanes_init();
+				ks->lanes_enc(fs.get(), buf.data(), count, TTA_LANES);
+			}, base[3]);
+			check("lanes.enc", name, lres);
+			if (ks == filter_kernel_sets[0])
+				tta_memcpy(base, rate, sizeof(base));
+		}
+	}
+} // bench_filters
+
+////////////////////////////// Entropy coder ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// the adaptive Rice coding of the filter residuals of one channel
+static void bench_entropy() {
+	const uint32_t count = BENCH_SAMPLES;
+
+	if (!bench_selected("rice")) return;
+
+	for (uint32_t depth : bench_depths)
+	for (int s = 0; s < SIGNALS; s++) {
+		int32_t shift = flt_set[depth - 1];
+		std::vector<int32_t> res = make_signal((signal_type) s, 1, depth, count);
+		std::vector<uint8_t> stream((size_t) count * 8 + 1024);
+		std::unique_ptr<codec_state> codec(new codec_state);
+		uint64_t size = 0;
+		spanio io;
+		bufio bio(&io);
+
+		codec->init(0, shift, 10, 10);
+		codec->encode(filter_kernel_sets[0], res.data(), count, 1);
+
+		bench_run("rice.put", "", signal_names[s], 1, depth * 8, "smp", count, [&]() {
+			io.assign_output(stream.data(), stream.size());
+			codec->init(0, shift, 10, 10);
+			bio.writer_start();
+			bio.reset();
+			for (uint32_t i = 0; i < count; i++)
+				bio.put_value(*codec, res[i]);
+			bio.flush_bit_cache();
+			bio.writer_done();
+			size = io.length();
+		});
+		bench_run("rice.get", "", signal_names[s], 1, depth * 8, "smp", count, [&]() {
+			int32_t sum = 0;
+			io.assign(stream.data(), size);
+			codec->init(0, shift, 10, 10);
+			bio.reader_start();
+			bio.reset();
+			for (uint32_t i = 0; i < count; i++)
+				sum += bio.get_value(*codec);
+			if (sum == 0x7fffffff) printf("\n"); // keep the loop
+		});
+	}
+} // bench_entropy
+
+/////////////////////////////////// CRC /////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+static void bench_crc() {
+	std::vector<uint8_t> data(BENCH_CRC_SIZE);
+	std::mt19937 rng(1);
+	uint32_t crc = 0;
+
+	if (!bench_selected("crc32")) return;
+
+	for (uint8_t &b : data) b = (uint8_t) rng();
+
+	bench_run("crc32", "slice8", "noise", 0, 0, "byte", data.size(), [&]() {
+		crc ^= crc32_slice8(0xffffffffUL, data.data(), (uint32_t) data.size());
+	});
+#if defined(CRC32_CLMUL)
+	if (__builtin_cpu_supports("pclmul"))
+		bench_run("crc32", "clmul", "noise", 0, 0, "byte", data.size(), [&]() {
+			crc ^= crc32_clmul(0xffffffffUL, data.data(), (uint32_t) data.size());
+		});
+#endif
+	if (crc == 0x12345678) printf("\n"); // keep the loops
+} // bench_crc
+
+//////////////////////////////// PCM passes /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// the PCM unpacking with the inter-channel correlation (read) and the
+// decorrelation with the packing (write), the frame data as in the codec
+static void bench_pcm() {
+	const uint32_t count = BENCH_RATE;
+
+	if (!bench_selected("pcm")) return;
+
+	for (uint32_t depth : bench_depths)
+	for (uint32_t nch : bench_channels) {
+		const codec_pass *pass = &codec_passes[(nch <= 2) ? nch : 0][depth - 2];
+		uint32_t stride = (nch > 2) ? TTA_LANES : nch;
+		std::vector<int32_t> values = make_signal(REAL, nch, depth, count);
+		std::vector<uint8_t> pcm = make_pcm(values, depth);
+		std::vector<uint8_t> out(pcm.size());
+		std::vector<int32_t> res((size_t) count * stride + 8);
+		uint64_t units = (uint64_t) count * nch;
+
+		bench_run("pcm.read", "", "real", nch, depth * 8, "smp", units, [&]() {
+			pass->read(pcm.data(), nch, count, res.data(), stride);
+		});
+		bench_run("pcm.write", "", "real", nch, depth * 8, "smp", units, [&]() {
+			pass->write(res.data(), stride, nch, count, out.data());
+		});
+	}
+} // bench_pcm
+
+//////////////////////////////// End to end /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// encoding and decoding of a stream in memory with the native kernels
+static void bench_codec() {
+	const uint32_t count = BENCH_SAMPLES;
+
+	if (!bench_selected("codec")) return;
+
+	for (uint32_t depth : bench_depths)
+	for (uint32_t nch : bench_channels)
+	for (int s = 0; s < SIGNALS; s++) {
+		std::vector<uint8_t> pcm = make_pcm(make_signal((signal_type) s, nch,
+			depth, count), depth);
+		size_t pcm_size = (size_t) count * nch * depth;
+		std::vector<uint8_t> tta(pcm_size + pcm_size / 2 + 65536);
+		std::vector<uint8_t> out(pcm_size);
+		uint64_t units = (uint64_t) count * nch;
+		uint64_t size = 0;
+		info i = { FORMAT_SIMPLE, nch, depth * 8, BENCH_RATE, count };
+
+		bench_run("codec.enc", arch_name(binary_version()), signal_names[s],
+			nch, depth * 8, "smp", units, [&]() {
+			encoder enc(std::span<uint8_t>(tta.data(), tta.size()));
+			info ei = i;
+			enc.init(&ei, 0, "");
+			enc.process_stream(std::span<const uint8_t>(pcm.data(), pcm_size));
+			enc.finalize();
+			size = enc.get_output_size();
+		});
+		bench_run("codec.dec", arch_name(binary_version()), signal_names[s],
+			nch, depth * 8, "smp", units, [&]() {
+			decoder dec(std::span<const uint8_t>(tta.data(), size));
+			info di;
+			dec.init(&di, 0, "");
+			dec.process_stream(std::span<uint8_t>(out.data(), out.size()));
+		});
+
+		if (memcmp(out.data(), pcm.data(), pcm_size))
+			fprintf(stderr, "codec: %s %u ch %u bits: mismatch\n",
+				signal_names[s], nch, depth * 8);
+	}
+} // bench_codec
+
+#if defined(__GNUC__) && !defined(CARIBBEAN)
+
+// encoding into a file and decoding it through fdio with the page cache,
+// O_DIRECT and the dropped pages; the length of the stream is not known
+// at init, so finalize seeks back over the written data for the headers
+static void bench_file() {
+	const uint32_t count = BENCH_SAMPLES, nch = 2, depth = 2;
+	static const uint32_t flags[] = { 0, FDIO_DIRECT, FDIO_DIRECT | FDIO_DONTNEED };
+	static const char *flag_names[] = { "cached", "direct", "direct+drop" };
+	std::vector<uint8_t> pcm = make_pcm(make_signal(REAL, nch, depth, count), depth);
+	uint32_t pcm_size = count * nch * depth;
+	std::vector<uint8_t> out(pcm_size);
+	uint64_t units = (uint64_t) count * nch;
+	char name[] = "tta_bench.XXXXXX";
+	int fd;
+
+	if (!bench_selected("file")) return;
+
+	fd = mkstemp(name);
+	if (fd < 0) {
+		fprintf(stderr, "file: can't create %s\n", name);
+		return;
+	}
+	unlink(name);
+
+	for (uint32_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+		bool failed = false;
+
+		bench_run("file.enc", flag_names[f], "real", nch, depth * 8, "smp", units, [&]() {
+			info i = { FORMAT_SIMPLE, nch, depth * 8, BENCH_RATE, 0 };
+
+			if (ftruncate(fd, 0) || lseek(fd, 0, SEEK_SET)) {
+				failed = true;
+				return;
+			}
+			fdio io(fd, 1 << 20, flags[f]);
+			encoder enc(&io);
+			enc.init(&i, 0, "");
+			enc.process_stream(pcm.data(), pcm_size);
+			enc.finalize();
+			if (!io.Flush()) failed = true;
+		});
+		bench_run("file.dec", flag_names[f], "real", nch, depth * 8, "smp", units, [&]() {
+			info i;
+
+			tta_memclear(out.data(), pcm_size);
+			if (lseek(fd, 0, SEEK_SET)) {
+				failed = true;
+				return;
+			}
+			try {
+				fdio io(fd, 1 << 20, flags[f]);
+				decoder dec(&io);
+				dec.init(&i, 0, "");
+				if (dec.process_stream(out.data(), pcm_size) != (int) count)
+					failed = true;
+			} catch (tta::exception &) {
+				failed = true;
+			}
+		});
+
+		if (failed || memcmp(out.data(), pcm.data(), pcm_size))
+			fprintf(stderr, "file: %s: mismatch\n", flag_names[f]);
+	}
+
+	close(fd);
+} // bench_file
+
+#endif // __GNUC__
+
+/////////////////////////////////// Main ////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+static void usage() {
+	fprintf(stderr, "usage: tta_bench [-t seconds] [group]\n\n");
+	fprintf(stderr, "  -t  time of each benchmark (%.1f s)\n", BENCH_TIME);
+	fprintf(stderr, "  group: filter, lanes, rice, crc32, pcm, codec, file "
+		"or a part of the name\n\n");
+} // usage
+
+int main(int argc, char **argv) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			bench_time = atof(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			usage();
+			return 1;
+		} else bench_filter = argv[i];
+	}
+
+	printf("%-12s %-14s %-8s %3s %5s %10s %9s\n", "benchmark", "variant",
+		"signal", "ch", "bits", "M/s", "cycles");
+
+	bench_filters();
+	bench_entropy();
+	bench_crc();
+	bench_pcm();
+	bench_codec();
+#if defined(__GNUC__) && !defined(CARIBBEAN)
+	bench_file();
+#endif
+
+	return 0;
+} // main
+
+/* eof */
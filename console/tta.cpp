@@ -10,9 +10,14 @@
  */
 
 #include "../libtta.h"
-#include "../config.h"
+#include "config.h"
 #include "tta.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 using namespace tta;
 
 //////////////////////// Constants and definitions //////////////////////////
@@ -82,8 +87,8 @@ void tta_strerror(tta::error e) {
 		case tta::error::FILE_CORRUPTED: tta_print("\r%s: file is corrupted\n", myname); break;
 		case tta::error::READ_FILE: tta_print("\r%s: can't read from input file\n", myname); break;
 		case tta::error::WRITE_FILE: tta_print("\r%s: can't write to output file\n", myname); break;
-		case tta::error::SEEK_FILE: tta_print("\r%s: insufficient memory available\n", myname); break;
-		case tta::error::MEMORY_INSUFFICIENT: tta_print("\r%s: file seek tta::error\n", myname); break;
+		case tta::error::SEEK_FILE: tta_print("\r%s: file seek error\n", myname); break;
+		case tta::error::MEMORY_INSUFFICIENT: tta_print("\r%s: insufficient memory available\n", myname); break;
 		case tta::error::PASSWORD_PROTECTED: tta_print("\r%s: password protected file\n", myname); break;
 		case tta::error::UNSUPPORTED_ARCH: tta_print("\r%s: unsupported architecture type\n", myname); break;
 		default: tta_print("\rUnknown error\n"); break;
@@ -91,13 +96,16 @@ void tta_strerror(tta::error e) {
 } // tta_strerror
 
 void usage() {
-	tta_print("\rUsage:\ttta [-hebd][p password] input_file output_file\n\n");
+	tta_print("\rUsage:\ttta [-hebd][p password][t threads] input_file output_file\n");
+	tta_print("\r\ttta [-hed][p password][t threads] -j jobs input_files... output_dir\n\n");
 
 	tta_print("\t-h\tprint this help\n");
 	tta_print("\t-e\tencode file\n");
 	tta_print("\t-eb\tblindly mode (ignore data size info)\n");
 	tta_print("\t-ep|dp\tpassword protection\n");
-	tta_print("\t-d\tdecode file\n\n");
+	tta_print("\t-d\tdecode file\n");
+	tta_print("\t-t\tnumber of worker threads\n");
+	tta_print("\t-j\tnumber of files processed at once\n\n");
 
 	tta_print("when file is '-', use standard input/output.\n\n");
 	tta_print("Project site: http://www.true-audio.com/\n");
@@ -246,6 +254,8 @@ uint8_t *convert_password(const TTAwchar *src, int *len) {
 /////////////////////////////////////////////////////////////////////////////
 
 void tta_callback(uint32_t rate, uint32_t fnum, uint32_t frames) {
+	if (!frames) return; // unknown length
+
 	uint32_t pcnt = (uint32_t)(fnum * 100. / frames);
 	if (!(pcnt % 10))
 		tta_print("\rProgress: %02d%%", pcnt);
@@ -253,7 +263,7 @@ void tta_callback(uint32_t rate, uint32_t fnum, uint32_t frames) {
 
 class tta_file_io : public fileio
 {
-private:
+protected:
 	HANDLE m_handle;
 public:
 	tta_file_io(HANDLE handle);
@@ -262,6 +272,7 @@ public:
 	int32_t Read(uint8_t *buffer, uint32_t size) override;
 	int32_t Write(uint8_t *buffer, uint32_t size) override;
 	int64_t Seek(int64_t offset) override;
+	bool Flush();
 };
 
 tta_file_io::tta_file_io(HANDLE handle) : m_handle(handle) {}
@@ -285,10 +296,362 @@ int64_t tta_file_io::Seek(int64_t offset) {
 	return tta_seek(m_handle, offset);
 }
 
+bool tta_file_io::Flush() {
+	return true;
+}
+
+#ifdef HAVE_IO_URING
+
+///////////////////////////// io_uring file io //////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+#define URING_DEPTH 4 // requests in flight
+#define URING_BUFFER_SIZE (256 * 1024)
+
+// Reads a regular file URING_DEPTH buffers ahead of the codec, or collects
+// the writes into large buffers written in the background, so the codec
+// doesn't wait for the storage. A file is either read or written until
+// the next Seek, which waits for the requests in flight. Pipes, and the
+// systems without io_uring, use the blocking calls of tta_file_io.
+class tta_uring_io : public tta_file_io
+{
+private:
+	typedef struct {
+		uint8_t *data;
+		struct iovec iov;
+		uint64_t offset;
+		uint32_t size; // bytes requested
+		uint32_t done; // bytes transferred so far
+		int32_t result;
+		uint8_t op;
+		bool busy;
+	} request;
+
+	enum { URING_UNTRIED, URING_OFF, URING_IDLE, URING_READ, URING_WRITE };
+
+	int m_ring;
+	int m_state;
+	void *m_sq_ring;
+	void *m_cq_ring;
+	size_t m_sq_size;
+	size_t m_cq_size;
+	struct io_uring_sqe *m_sqes;
+	size_t m_sqes_size;
+	unsigned *m_sq_tail;
+	unsigned *m_sq_mask;
+	unsigned *m_sq_array;
+	unsigned *m_cq_head;
+	unsigned *m_cq_tail;
+	unsigned *m_cq_mask;
+	struct io_uring_cqe *m_cqes;
+	request m_req[URING_DEPTH];
+	uint32_t m_cur; // the buffer being read or filled
+	uint32_t m_pos; // position in it
+	uint64_t m_offset; // file offset of the next request
+	bool m_error;
+
+	bool start();
+	bool setup();
+	void release();
+	void submit(uint32_t n, uint8_t op, uint32_t size);
+	void enqueue(uint32_t n);
+	bool wait(uint32_t n);
+	bool drain();
+
+public:
+	tta_uring_io(HANDLE handle);
+	~tta_uring_io();
+
+	int32_t Read(uint8_t *buffer, uint32_t size) override;
+	int32_t Write(uint8_t *buffer, uint32_t size) override;
+	int64_t Seek(int64_t offset) override;
+	bool Flush();
+};
+
+tta_uring_io::tta_uring_io(HANDLE handle) : tta_file_io(handle),
+	m_ring(-1), m_state(URING_UNTRIED), m_sq_ring(MAP_FAILED),
+	m_cq_ring(MAP_FAILED), m_sqes((struct io_uring_sqe *) MAP_FAILED),
+	m_cur(0), m_pos(0), m_offset(0), m_error(false) {
+	tta_memclear(m_req, sizeof(m_req));
+}
+
+tta_uring_io::~tta_uring_io() {
+	Flush();
+	release();
+}
+
+// the ring is set up on the first use, for regular files only
+bool tta_uring_io::start() {
+	struct stat st;
+
+	if (m_state == URING_UNTRIED) {
+		m_state = URING_OFF;
+		if (!fstat(m_handle, &st) && S_ISREG(st.st_mode)) {
+			if (setup()) {
+				m_offset = lseek64(m_handle, 0, SEEK_CUR);
+				m_state = URING_IDLE;
+			} else release();
+		}
+	}
+
+	return m_state != URING_OFF;
+} // start
+
+bool tta_uring_io::setup() {
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	tta_memclear(&p, sizeof(p));
+	m_ring = (int) syscall(__NR_io_uring_setup, URING_DEPTH, &p);
+	if (m_ring < 0) return false;
+
+	m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (m_cq_size > m_sq_size) m_sq_size = m_cq_size;
+		m_cq_size = 0;
+	}
+
+	m_sq_ring = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+	if (m_sq_ring == MAP_FAILED) return false;
+	if (m_cq_size) {
+		m_cq_ring = mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+		if (m_cq_ring == MAP_FAILED) return false;
+	}
+	m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	m_sqes = (struct io_uring_sqe *) mmap(NULL, m_sqes_size,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+		IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED) return false;
+
+	sq = (uint8_t *) m_sq_ring;
+	cq = m_cq_size ? (uint8_t *) m_cq_ring : sq;
+	m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	m_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	m_sq_array = (unsigned *)(sq + p.sq_off.array);
+	m_cq_head = (unsigned *)(cq + p.cq_off.head);
+	m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	for (uint32_t n = 0; n < URING_DEPTH; n++) {
+		m_req[n].data = (uint8_t *) tta_malloc(URING_BUFFER_SIZE);
+		if (m_req[n].data == NULL) return false;
+	}
+
+	return true;
+} // setup
+
+void tta_uring_io::release() {
+	if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_size);
+	if (m_cq_ring != MAP_FAILED) munmap(m_cq_ring, m_cq_size);
+	if (m_sq_ring != MAP_FAILED) munmap(m_sq_ring, m_sq_size);
+	if (m_ring >= 0) close(m_ring); // cancels the requests in flight
+
+	for (uint32_t n = 0; n < URING_DEPTH; n++)
+		if (m_req[n].data) tta_free(m_req[n].data);
+
+	tta_memclear(m_req, sizeof(m_req));
+	m_sqes = (struct io_uring_sqe *) MAP_FAILED;
+	m_sq_ring = m_cq_ring = MAP_FAILED;
+	m_ring = -1;
+} // release
+
+void tta_uring_io::submit(uint32_t n, uint8_t op, uint32_t size) {
+	request *r = &m_req[n];
+
+	r->op = op;
+	r->size = size;
+	r->done = 0;
+	r->offset = m_offset;
+	m_offset += size;
+
+	enqueue(n);
+} // submit
+
+// sends the request n for the bytes not transferred yet
+void tta_uring_io::enqueue(uint32_t n) {
+	request *r = &m_req[n];
+	unsigned tail = *m_sq_tail;
+	unsigned index = tail & *m_sq_mask;
+	struct io_uring_sqe *sqe = &m_sqes[index];
+	long ret;
+
+	r->iov.iov_base = r->data + r->done;
+	r->iov.iov_len = r->size - r->done;
+
+	tta_memclear(sqe, sizeof(*sqe));
+	sqe->opcode = r->op;
+	sqe->fd = m_handle;
+	sqe->addr = (uint64_t)(uintptr_t) &r->iov;
+	sqe->len = 1;
+	sqe->off = r->offset + r->done;
+	sqe->user_data = n;
+	m_sq_array[index] = index;
+	__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do ret = syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, NULL, 0);
+	while (ret < 0 && errno == EINTR);
+
+	r->busy = (ret == 1);
+	if (!r->busy) m_error = true;
+} // enqueue
+
+// waits for the request n, collects the completions on the way; a short
+// transfer goes on from where it stopped, only a read of 0 bytes (the end
+// of the file) or an error ends a request early
+bool tta_uring_io::wait(uint32_t n) {
+	struct io_uring_cqe *cqe;
+	request *r;
+	unsigned head;
+	int32_t res;
+
+	while (m_req[n].busy) {
+		head = *m_cq_head;
+		if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+			if (syscall(__NR_io_uring_enter, m_ring, 0, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+				m_error = true;
+				break;
+			}
+			continue;
+		}
+
+		cqe = &m_cqes[head & *m_cq_mask];
+		r = &m_req[cqe->user_data];
+		res = cqe->res;
+		__atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+
+		if (res > 0 && r->done + res < r->size) {
+			r->done += res;
+			enqueue((uint32_t)(r - m_req));
+			continue;
+		}
+
+		if (res > 0) r->done += res;
+		r->result = (res < 0) ? res : (int32_t) r->done;
+		r->busy = false;
+		if (r->op == IORING_OP_WRITEV && r->result != (int32_t) r->size)
+			m_error = true;
+	}
+
+	return !m_error;
+} // wait
+
+// sends out the last write buffer and waits for all the requests
+bool tta_uring_io::drain() {
+	if (m_state == URING_WRITE && m_pos && !m_error)
+		submit(m_cur, IORING_OP_WRITEV, m_pos);
+	else if (m_state == URING_READ)
+		m_offset = m_req[m_cur].offset + m_pos;
+	m_cur = m_pos = 0;
+
+	for (uint32_t n = 0; n < URING_DEPTH; n++)
+		wait(n);
+
+	return !m_error;
+} // drain
+
+int32_t tta_uring_io::Read(uint8_t *buffer, uint32_t size) {
+	uint32_t done = 0, len;
+	request *r;
+
+	if (!start()) return tta_file_io::Read(buffer, size);
+
+	if (m_state != URING_READ) {
+		if (!drain()) return 0;
+		m_state = URING_READ;
+		for (uint32_t n = 0; n < URING_DEPTH; n++)
+			submit(n, IORING_OP_READV, URING_BUFFER_SIZE);
+	}
+
+	while (done < size) {
+		r = &m_req[m_cur];
+		if (!wait(m_cur) || r->result < 0) {
+			m_error = true;
+			break;
+		}
+
+		len = r->result - m_pos;
+		if (!len) {
+			if (r->result < URING_BUFFER_SIZE) break; // end of file
+			submit(m_cur, IORING_OP_READV, URING_BUFFER_SIZE);
+			m_cur = (m_cur + 1) % URING_DEPTH;
+			m_pos = 0;
+			continue;
+		}
+
+		if (len > size - done) len = size - done;
+		tta_memcpy(buffer + done, r->data + m_pos, len);
+		m_pos += len;
+		done += len;
+	}
+
+	return done;
+}
+
+int32_t tta_uring_io::Write(uint8_t *buffer, uint32_t size) {
+	uint32_t done = 0, len;
+
+	if (!start()) return tta_file_io::Write(buffer, size);
+
+	if (m_state != URING_WRITE) {
+		if (!drain()) return 0;
+		m_state = URING_WRITE;
+	}
+
+	while (done < size && !m_error) {
+		len = URING_BUFFER_SIZE - m_pos;
+		if (len > size - done) len = size - done;
+		tta_memcpy(m_req[m_cur].data + m_pos, buffer + done, len);
+		m_pos += len;
+		done += len;
+
+		if (m_pos == URING_BUFFER_SIZE) {
+			submit(m_cur, IORING_OP_WRITEV, m_pos);
+			m_cur = (m_cur + 1) % URING_DEPTH;
+			m_pos = 0;
+			wait(m_cur);
+		}
+	}
+
+	return m_error ? 0 : size;
+}
+
+int64_t tta_uring_io::Seek(int64_t offset) {
+	if (!start()) return tta_file_io::Seek(offset);
+	if (!drain()) return -1;
+
+	m_state = URING_IDLE;
+	m_offset = offset;
+
+	return offset;
+}
+
+// waits for the writes, false if any of them failed
+bool tta_uring_io::Flush() {
+	bool ret;
+
+	if (m_state == URING_UNTRIED || m_state == URING_OFF)
+		return tta_file_io::Flush();
+
+	ret = drain();
+	m_state = URING_IDLE;
+
+	return ret;
+}
+
+typedef tta_uring_io tta_async_io;
+#else // !HAVE_IO_URING
+typedef tta_file_io tta_async_io;
+#endif // HAVE_IO_URING
+
 int test_libtta_compatibility() {
 	cpu_arch arch = binary_version();
 
-	if (arch == cpu_arch::UNKNOWN) return 0;
+	if (arch == cpu_arch::UNKNOWN || arch == cpu_arch::PORTABLE_SIMD) return 0;
 
 #if defined(CPU_X86)
 	{
@@ -301,10 +664,20 @@ int test_libtta_compatibility() {
 	else if (arch == cpu_arch::IX86_AVX) {
 		bool avx = cx & (1 << 28) || false;
 		bool xsave = cx & (1 << 27) || false;
-		if (xsave && avx) {
+		tta_cpuid(7, ax, bx, cx, dx);
+		bool avx2 = bx & (1 << 5) || false;
+		if (xsave && avx && avx2) {
 			unsigned long long mask = tta_xgetbv(0);
 			if ((mask & 0x6) == 0x6) return 0;
 		}
+	} else if (arch == cpu_arch::IX86_AVX512) {
+		bool xsave = cx & (1 << 27) || false;
+		tta_cpuid(7, ax, bx, cx, dx);
+		bool avx512 = (bx & (1 << 16)) && (bx & (1u << 31)); // F, VL
+		if (xsave && avx512) {
+			unsigned long long mask = tta_xgetbv(0);
+			if ((mask & 0xe6) == 0xe6) return 0;
+		}
 	}
 	}
 #elif defined(CPU_ARM)
@@ -323,12 +696,13 @@ int test_libtta_compatibility() {
 //////////////////////////////// Compress ///////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 template<enum impl_type it>
-int compress(HANDLE infile, HANDLE outfile, HANDLE tmpfile, const std::string& password) {
+int compress(HANDLE infile, HANDLE outfile, HANDLE tmpfile, bool blind, const std::string& password, uint32_t threads, CALLBACK callback) {
 	uint32_t data_size;
 	WAVE_hdr wave_hdr;
-	tta_file_io io(outfile);
+	tta_async_io io(outfile);
 	uint8_t *buffer = NULL;
-	uint32_t buf_size, smp_size, len, res;
+	uint32_t buf_size, smp_size, size, len, res, rest = 0;
+	uint64_t bound;
 	info i;
 	int ret = -1;
 
@@ -364,7 +738,11 @@ int compress(HANDLE infile, HANDLE outfile, HANDLE tmpfile, const std::string& p
 		goto done;
 	}
 
-	if (tmpfile != INVALID_HANDLE_VALUE) {
+	// the encoder counts the samples of a blind stream, it seeks back for
+	// the headers and reserves the seek table for the size of the input
+	// file; for a pipe on either side the input is buffered in 'tmpfile'
+	// first to count them
+	if (blind && tmpfile != INVALID_HANDLE_VALUE) {
 		data_size = 0;
 		while (tta_read(infile, buffer, buf_size, len) && len) {
 			if (!tta_write(tmpfile, buffer, len, res) || !res) {
@@ -376,6 +754,11 @@ int compress(HANDLE infile, HANDLE outfile, HANDLE tmpfile, const std::string& p
 		tta_print("\rBuffered: %d bytes\n", data_size);
 		infile = tmpfile;
 		tta_reset(infile);
+		blind = false;
+	} else if (blind) {
+		data_size = 0;
+		bound = tta_file_size(infile) / smp_size;
+		enc.set_stream_length((bound < UINT32_MAX) ? (uint32_t) bound : 0);
 	} else if (data_size >= 0x7fffffff) {
 		tta_print("\r%s: incorrect data size info in wav file\n", myname);
 		goto done;
@@ -384,22 +767,46 @@ int compress(HANDLE infile, HANDLE outfile, HANDLE tmpfile, const std::string& p
 	i.samples = data_size / smp_size;
 
 	try {
-		enc.init(&i, 0, password);
+		tta_async_io pcm(infile);
 
-		while (data_size > 0) {
-			buf_size = (buf_size < data_size) ? buf_size : data_size;
+		enc.init(&i, 0, password);
 
-			if (!tta_read(infile, buffer, buf_size, len) || !len)
-				throw exception(error::READ_FILE);
+		// keep a couple of frames per worker in flight
+		if (threads > 1) {
+			tta_free(buffer);
+			buf_size = threads * 2 * enc.get_frame_length() * smp_size;
+			buffer = (uint8_t *) tta_malloc(buf_size + 4); // +4 for READ_BUFFER macro
+			if (buffer == NULL)
+				throw exception(error::MEMORY_INSUFFICIENT);
+		}
 
-			if (len) {
-				enc.encode_stream<it>(buffer, len, tta_callback);
-			} else break;
+		while (blind || data_size > 0) {
+			size = buf_size - rest;
+			if (!blind && size > data_size) size = data_size;
 
-			data_size -= len;
+			len = pcm.Read(buffer + rest, size);
+			if ((int32_t) len < 0 || (!len && !blind))
+				throw exception(error::READ_FILE);
+			if (!len) break;
+			if (!blind) data_size -= len;
+
+			// pipes may return a part of sample, keep it for the next read
+			len += rest;
+			rest = len % smp_size;
+			enc.encode_stream_mt<it>(buffer, len - rest, threads, 0, callback);
+			memmove(buffer, buffer + len - rest, rest);
 		}
 
-		enc.finalize();
+		try {
+			enc.finalize();
+		} catch (exception& ex) {
+			// a pipe gets the stream without the seek table
+			if (ex.error() != error::SEEK_FILE || tta_seekable(outfile))
+				throw;
+			tta_print("\r%s: output is not seekable, seek table not written\n", myname);
+		}
+		if (!io.Flush())
+			throw exception(error::WRITE_FILE);
 		ret = 0;
 	} catch (exception& ex) {
 		tta_strerror(ex.error());
@@ -414,16 +821,22 @@ done:
 /////////////////////////////// Decompress //////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 template<enum impl_type it>
-int decompress(HANDLE infile, HANDLE outfile, const std::string& password) {
+int decompress(HANDLE infile, HANDLE outfile, const std::string& password, uint32_t threads, CALLBACK callback) {
 	WAVE_hdr wave_hdr;
-	tta_file_io io(infile);
+	tta_async_io io(infile);
+	spanio map_io;
 	uint8_t *buffer = NULL;
-	uint32_t buf_size, smp_size, data_size, res;
+	uint32_t buf_size, smp_size, data_size;
+	uint64_t map_size = 0;
 	int32_t len;
 	info i;
 	int ret = -1;
 
-	decoder dec(&io);
+	// read a regular file straight from memory, else ahead of the decoder
+	void *map = tta_map(infile, &map_size);
+	if (map) map_io.assign((const uint8_t *) map, map_size);
+
+	decoder dec(map ? (fileio *) &map_io : (fileio *) &io);
 
 	try {
 		dec.init(&i, 0, password);
@@ -435,6 +848,10 @@ int decompress(HANDLE infile, HANDLE outfile, const std::string& password) {
 	smp_size = i.nch * ((i.bps + 7) / 8);
 	buf_size = PCM_BUFFER_LENGTH * smp_size;
 
+	// keep a couple of frames per worker in flight
+	if (threads > 1)
+		buf_size = threads * 2 * dec.get_frame_length() * smp_size;
+
 	// allocate memory for PCM buffer
 	buffer = (uint8_t *) tta_malloc(buf_size + 4); // +4 for WRITE_BUFFER macro
 	if (buffer == NULL) {
@@ -464,13 +881,18 @@ int decompress(HANDLE infile, HANDLE outfile, const std::string& password) {
 	}
 
 	try {
+		tta_async_io pcm(outfile);
+
 		while (1) {
-			len = dec.decode_stream<it>(buffer, buf_size, tta_callback);
+			len = dec.decode_stream_mt<it>(buffer, buf_size, threads, callback);
 			if (len) {
-				if (!tta_write(outfile, buffer, len * smp_size, res) || !res)
+				if (pcm.Write(buffer, len * smp_size) != (int32_t)(len * smp_size))
 					throw exception(error::WRITE_FILE);
 			} else break;
 		}
+
+		if (!pcm.Flush())
+			throw exception(error::WRITE_FILE);
 		ret = 0;
 	} catch (exception& ex) {
 		tta_strerror(ex.error());
@@ -478,10 +900,95 @@ int decompress(HANDLE infile, HANDLE outfile, const std::string& password) {
 
 done:
 	if (buffer) tta_free(buffer);
+	if (map) tta_unmap(map, map_size);
 
 	return ret;
 } // decompress
 
+///////////////////////////////// Batch /////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+typedef std::basic_string<TTAwchar> tta_string;
+
+// the name of the output file in 'dir', with the extension replaced
+tta_string batch_name(const TTAwchar *name, const TTAwchar *dir, int act) {
+	const TTAwchar *base = name, *ext = NULL, *p;
+	tta_string out(dir);
+
+	for (p = name; *p; p++) {
+		if (*p == '/' || *p == '\\') {
+			base = p + 1;
+			ext = NULL;
+		} else if (*p == '.') ext = p;
+	}
+	if (ext == NULL || ext == base) ext = p;
+
+	if (!out.empty() && out.back() != '/' && out.back() != '\\')
+		out += '/';
+	out.append(base, ext);
+	out += (act == 1) ? T(".tta") : T(".wav");
+
+	return out;
+} // batch_name
+
+// encodes or decodes 'count' files into the directory 'dir', 'jobs' files
+// at a time with 'threads' worker threads each
+template<enum impl_type it>
+int batch(int act, TTAwchar **files, int count, const TTAwchar *dir, bool blind, const std::string& password, uint32_t jobs, uint32_t threads) {
+	std::vector<std::thread> pool;
+	std::vector<tta_string> names, sorted;
+	std::atomic<int> next(0);
+	std::atomic<int> failed(0);
+
+	// two inputs with the same base name would be written to one file
+	for (int k = 0; k < count; k++)
+		names.push_back(batch_name(files[k], dir, act));
+	sorted = names;
+	std::sort(sorted.begin(), sorted.end());
+	auto same = std::adjacent_find(sorted.begin(), sorted.end());
+	if (same != sorted.end()) {
+		tta_print("\r%s: output name collision: \"%s\"\n", myname, same->c_str());
+		return -1;
+	}
+
+	auto worker = [&]() {
+		HANDLE infile, outfile;
+		int k, ret;
+
+		while ((k = next++) < count) {
+			const tta_string& name = names[k];
+			ret = -1;
+
+			infile = tta_open_read(files[k]);
+			if (infile != INVALID_HANDLE_VALUE) {
+				outfile = tta_open_write(name.c_str());
+				if (outfile != INVALID_HANDLE_VALUE) {
+					if (act == 1)
+						ret = compress<it>(infile, outfile, INVALID_HANDLE_VALUE, blind, password, threads, nullptr);
+					else ret = decompress<it>(infile, outfile, password, threads, nullptr);
+					tta_close(outfile);
+					if (ret) tta_unlink(name.c_str());
+				} else tta_strerror(error::OPEN_FILE);
+				tta_close(infile);
+			} else tta_strerror(error::OPEN_FILE);
+
+			if (ret) {
+				tta_print("\rFailed: \"%s\"\n", files[k]);
+				failed++;
+			} else tta_print("\rDone: \"%s\" to \"%s\"\n", files[k], name.c_str());
+		}
+	};
+
+	if (jobs > (uint32_t) count) jobs = count;
+	for (uint32_t n = 1; n < jobs; n++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool)
+		t.join();
+
+	return failed ? -1 : 0;
+} // batch
+
 //////////////////////////// The main function //////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 int tta_main(int argc, TTAwchar **argv) {
@@ -497,6 +1004,9 @@ int tta_main(int argc, TTAwchar **argv) {
 	int pwlen = 0;
 	int blind = 0;
 	int ret = -1;
+	uint32_t threads = 1;
+	uint32_t jobs = 0;
+	int files;
 	char c;
 	bool force_compat = false;
 
@@ -509,16 +1019,12 @@ int tta_main(int argc, TTAwchar **argv) {
 		force_compat = true;
 	}
 
-	if (argc > 3) {
-		fname_in = argv[argc - 2];
-		fname_out = argv[argc - 1];
-		argc -= 2;
-	} else {
+	if (argc < 4) {
 		usage();
 		goto done;
 	}
 
-	while ((c = getopt(argc, argv, "hcedbp:")) != -1)
+	while ((c = getopt(argc, argv, "hcedbp:t:j:")) != -1)
 	switch (c) {
 		case 'h': // print help
 			usage();
@@ -549,6 +1055,14 @@ int tta_main(int argc, TTAwchar **argv) {
 			}
 			password.assign(pwstr, pwstr+pwlen);
 			break;
+		case 't': // worker threads
+			threads = (uint32_t) atoi(optarg);
+			if (threads < 1) threads = 1;
+			break;
+		case 'j': // batch mode
+			jobs = (uint32_t) atoi(optarg);
+			if (jobs < 1) jobs = 1;
+			break;
 		case 'b': // blindly mode
 			if (act == 2) {
 				tta_print("\r%s: option '-b' is not supported by decoder\n", myname);
@@ -561,11 +1075,33 @@ int tta_main(int argc, TTAwchar **argv) {
 			goto done;
 	}
 
-	if (!act) {
+	files = argc - optind;
+	if (!act || files < 2) {
 		tta_print("\r%s: commandline options incomplete\n", myname);
 		goto done;
 	}
 
+	if (jobs) {
+		start = GetTickCount();
+		if (force_compat) {
+			ret = batch<impl_type::compat>(act, argv + optind, files - 1, argv[argc - 1], blind, password, jobs, threads);
+		} else {
+			ret = batch<impl_type::native>(act, argv + optind, files - 1, argv[argc - 1], blind, password, jobs, threads);
+		}
+		if (!ret) {
+			end = GetTickCount();
+			tta_print("\rTime: %.3f sec.\n",
+				(end - start) / 1000.);
+		}
+		goto done;
+	} else if (files != 2) {
+		usage();
+		goto done;
+	}
+
+	fname_in = argv[optind];
+	fname_out = argv[optind + 1];
+
 	if (*fname_in == '-' && *(fname_in + 1) == '\0')
 		infile = STDIN_FILENO;
 	else infile = tta_open_read(fname_in);
@@ -588,19 +1124,19 @@ int tta_main(int argc, TTAwchar **argv) {
 	switch (act) {
 	case 1:
 		tta_print("\rEncoding: \"%s\" to \"%s\"\n", fname_in, fname_out);
-		if (blind) {
+		if (blind && (!tta_seekable(outfile) || !tta_file_size(infile))) {
 			tmpfile = mkstemp(fname_tmp);
 			if (tmpfile == INVALID_HANDLE_VALUE) {
-				tta_print("\r%s: can't create tempfile: \"%s\"\n", fname_tmp, myname);
+				tta_print("\r%s: can't create tempfile: \"%s\"\n", myname, fname_tmp);
 				goto done;
 			} else tta_print("\rTempfile: \"%s\"\n", fname_tmp);
 		}
 		if (force_compat) {
-			ret = compress<impl_type::compat>(infile, outfile, tmpfile, password);
+			ret = compress<impl_type::compat>(infile, outfile, tmpfile, blind, password, threads, tta_callback);
 		} else {
-			ret = compress<impl_type::native>(infile, outfile, tmpfile, password);
+			ret = compress<impl_type::native>(infile, outfile, tmpfile, blind, password, threads, tta_callback);
 		}
-		if (blind && tmpfile != INVALID_HANDLE_VALUE) {
+		if (tmpfile != INVALID_HANDLE_VALUE) {
 			tta_close(tmpfile);
 			tta_unlink(fname_tmp);
 		}
@@ -608,9 +1144,9 @@ int tta_main(int argc, TTAwchar **argv) {
 	case 2:
 		tta_print("\rDecoding: \"%s\" to \"%s\"\n", fname_in, fname_out);
 		if (force_compat) {
-			ret = decompress<impl_type::compat>(infile, outfile, password);
+			ret = decompress<impl_type::compat>(infile, outfile, password, threads, tta_callback);
 		} else {
-			ret = decompress<impl_type::native>(infile, outfile, password);			
+			ret = decompress<impl_type::native>(infile, outfile, password, threads, tta_callback);
 		}
 		break;
 	}
@@ -22,7 +22,18 @@
 #endif
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#ifndef __NR_io_uring_setup
+#undef HAVE_IO_URING
+#endif
+#endif
 #include <stdio.h>
 #include <locale.h>
 #else // MSVC
@@ -72,7 +83,7 @@ typedef int (HANDLE);
 #define tta_reset(__handle) lseek64(__handle,0,SEEK_SET)
 #define tta_cpuid(func,ax,bx,cx,dx) \
 	__asm__ __volatile__ ("cpuid": \
-	"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func));
+	"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func), "c" (0));
 #endif // GNUC
 #else // MSVC
 typedef wchar_t (TTAwchar);
@@ -94,7 +105,7 @@ typedef wchar_t (TTAwchar);
 #define tta_reset(__handle) SetFilePointer(__handle,0,0,FILE_BEGIN)
 #define tta_cpuid(func,ax,bx,cx,dx) { \
 	int cpuid[4]; \
-	__cpuid(cpuid,func); ax=cpuid[0]; bx=cpuid[1]; cx=cpuid[2]; dx=cpuid[3]; }
+	__cpuidex(cpuid,func,0); ax=cpuid[0]; bx=cpuid[1]; cx=cpuid[2]; dx=cpuid[3]; }
 #endif // MSVC
 
 #ifdef __GNUC__
@@ -104,6 +115,56 @@ uint32_t GetTickCount() {
 	return (tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+// maps a regular file into memory for reading, NULL for pipes
+void *tta_map(HANDLE handle, uint64_t *size) {
+#ifdef CARIBBEAN
+	return NULL;
+#else
+	struct stat st;
+	void *data;
+
+	if (fstat(handle, &st) || !S_ISREG(st.st_mode) || !st.st_size)
+		return NULL;
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, handle, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	madvise(data, st.st_size, MADV_WILLNEED);
+	*size = st.st_size;
+	return data;
+#endif
+} // tta_map
+
+void tta_unmap(void *data, uint64_t size) {
+#ifndef CARIBBEAN
+	munmap(data, size);
+#endif
+} // tta_unmap
+
+// a file the encoder can seek back in, false for pipes
+bool tta_seekable(HANDLE handle) {
+#ifdef CARIBBEAN
+	return true;
+#else
+	struct stat st;
+
+	return !fstat(handle, &st) && S_ISREG(st.st_mode);
+#endif
+} // tta_seekable
+
+// the size of a regular file, 0 for pipes
+uint64_t tta_file_size(HANDLE handle) {
+#ifdef CARIBBEAN
+	return 0;
+#else
+	struct stat st;
+
+	if (fstat(handle, &st) || !S_ISREG(st.st_mode))
+		return 0;
+	return st.st_size;
+#endif
+} // tta_file_size
+
 extern TTAwchar *optarg;
 extern int optind;
 
@@ -166,6 +227,42 @@ HANDLE mkstemp(TTAwchar *name_buffer) {
 	return INVALID_HANDLE_VALUE;
 } // tta_mktemp
 
+// maps a regular file into memory for reading, NULL for pipes
+void *tta_map(HANDLE handle, uint64_t *size) {
+	LARGE_INTEGER len;
+	HANDLE mapping;
+	void *data;
+
+	if (GetFileType(handle) != FILE_TYPE_DISK ||
+		!GetFileSizeEx(handle, &len) || !len.QuadPart)
+		return NULL;
+	mapping = CreateFileMappingW(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return NULL;
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data != NULL) *size = len.QuadPart;
+	return data;
+} // tta_map
+
+void tta_unmap(void *data, uint64_t size) {
+	UnmapViewOfFile(data);
+} // tta_unmap
+
+// a file the encoder can seek back in, false for pipes
+bool tta_seekable(HANDLE handle) {
+	return GetFileType(handle) == FILE_TYPE_DISK;
+} // tta_seekable
+
+// the size of a regular file, 0 for pipes
+uint64_t tta_file_size(HANDLE handle) {
+	LARGE_INTEGER len;
+
+	if (GetFileType(handle) != FILE_TYPE_DISK || !GetFileSizeEx(handle, &len))
+		return 0;
+	return len.QuadPart;
+} // tta_file_size
+
 #endif // MSVC
 
 #endif // _TTA_H
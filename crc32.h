@@ -0,0 +1,224 @@
+/*
+ * crc32.h
+ *
+ * Description: TTA frame checksum functions
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+// The checksum is the reflected CRC-32 (polynomial 0xedb88320). The
+// functions update the running register value over a span of bytes, the
+// initial value and the final inversion are left to the caller. They are
+// inline rather than static, so a program has one copy of each.
+
+#define CRC32_POLY 0xedb88320UL
+
+// table of 8 slices, the first one is the classic byte-wise table
+struct crc32_slices {
+	uint32_t t[8][256];
+
+	constexpr crc32_slices() : t() {
+		uint32_t i, j, crc;
+
+		for (i = 0; i < 256; i++) {
+			crc = i;
+			for (j = 0; j < 8; j++)
+				crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLY : 0);
+			t[0][i] = crc;
+		}
+
+		for (i = 0; i < 256; i++)
+			for (j = 1; j < 8; j++)
+				t[j][i] = (t[j - 1][i] >> 8) ^ t[0][t[j - 1][i] & 0xff];
+	}
+};
+
+inline constexpr crc32_slices crc32_table;
+
+////////////////////////////// crc32_slice8 /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+inline uint32_t crc32_slice8(uint32_t crc, const uint8_t *p,
+	uint32_t len) {
+	const uint32_t (*t)[256] = crc32_table.t;
+	uint32_t lo, hi;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+			(uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+		hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 |
+			(uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+			t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+			t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+
+	for (; len; len--, p++)
+		crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+
+	return crc;
+} // crc32_slice8
+
+#if defined(CPU_X86) && defined(__GNUC__)
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#define CRC32_CLMUL
+
+/////////////////////////////// crc32_clmul /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// Folds 4 blocks of 16 bytes in parallel with carry-less multiplication,
+// then reduces to 32 bits (Intel, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction"). The tail is done by slices.
+__attribute__((target("sse2,pclmul")))
+inline uint32_t crc32_clmul(uint32_t crc, const uint8_t *p, uint32_t len) {
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	if (len < 64)
+		return crc32_slice8(crc, p, len);
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+	p += 64; len -= 64;
+
+	// fold by 4
+	for (; len >= 64; len -= 64, p += 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			_mm_loadu_si128((const __m128i *)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+			_mm_loadu_si128((const __m128i *)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+			_mm_loadu_si128((const __m128i *)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+			_mm_loadu_si128((const __m128i *)(p + 0x30)));
+	}
+
+	// fold 4 blocks into 1
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// fold by 1
+	for (; len >= 16; len -= 16, p += 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			_mm_loadu_si128((const __m128i *) p));
+	}
+
+	// fold 128 bits to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	crc = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+
+	return crc32_slice8(crc, p, len);
+} // crc32_clmul
+
+#endif // CRC32_CLMUL
+
+/////////////////////////////// crc32_shift /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// The register passed through 'len' zero bytes is a linear function of
+// the register, kept as 4 tables for its bytes. With the running registers
+// s0 and s1 before and after a run of 'len' bytes, the register of the run
+// alone from 'init' is s1 ^ zeros(s0 ^ init), so the crcs of all the
+// windows of one length follow from a single pass.
+struct crc32_shift {
+	uint32_t t[4][256];
+
+	static uint32_t apply(const uint32_t *op, uint32_t x) {
+		uint32_t r = 0;
+		for (const uint32_t *p = op; x; x >>= 1, p++)
+			if (x & 1) r ^= *p;
+		return r;
+	}
+
+	explicit crc32_shift(uint32_t len) {
+		uint32_t op[32], res[32], tmp[32], i, b;
+
+		// one zero byte, then the powers of it by squaring
+		for (i = 0; i < 32; i++) {
+			op[i] = ((1UL << i) >> 8) ^ crc32_table.t[0][(1UL << i) & 0xff];
+			res[i] = 1UL << i;
+		}
+		for (; len; len >>= 1) {
+			if (len & 1) {
+				for (i = 0; i < 32; i++) tmp[i] = apply(op, res[i]);
+				for (i = 0; i < 32; i++) res[i] = tmp[i];
+			}
+			for (i = 0; i < 32; i++) tmp[i] = apply(op, op[i]);
+			for (i = 0; i < 32; i++) op[i] = tmp[i];
+		}
+
+		for (b = 0; b < 4; b++)
+			for (i = 0; i < 256; i++)
+				t[b][i] = apply(res, i << (b * 8));
+	}
+
+	uint32_t zeros(uint32_t crc) const {
+		return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^
+			t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+	}
+};
+
+typedef uint32_t (*crc32_func)(uint32_t, const uint8_t *, uint32_t);
+
+// the fastest implementation supported by the cpu
+inline crc32_func crc32_select() {
+#if defined(CRC32_CLMUL)
+	__builtin_cpu_init(); // may run before the constructors
+	if (__builtin_cpu_supports("pclmul"))
+		return crc32_clmul;
+#endif
+	return crc32_slice8;
+} // crc32_select
+
+// picks the implementation on the first call, one choice is shared by
+// every translation unit
+inline uint32_t crc32_span(uint32_t crc, const uint8_t *p, uint32_t len) {
+	static const crc32_func func = crc32_select();
+	return func(crc, p, len);
+} // crc32_span
+
+#endif // _CRC32_H
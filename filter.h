@@ -25,6 +25,13 @@ typedef struct {
 
 #define CODEC_STATE_ALIGNMENT 16 // default
 
+// instruction set of a single function
+#if defined(__GNUC__)
+#define TTA_TARGET(t) __attribute__((target(t)))
+#else // MSVC
+#define TTA_TARGET(t)
+#endif
+
 ///////////////////////// hybrid_filter_compat_dec //////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 static __inline void hybrid_filter_compat_dec(TTA_fltst *fs, int32_t *in) {
@@ -98,128 +105,13 @@ static __inline void hybrid_filter_compat_enc(TTA_fltst *fs, int32_t *in) {
 #if defined(CPU_ARM) && defined(ENABLE_ASM) // implements in filter_arm.S
 	extern int hybrid_filter_dec(TTA_fltst *fs, int *in);
 	extern int hybrid_filter_enc(TTA_fltst *fs, int *in);
-#elif defined(CPU_X86) && defined(ENABLE_AVX)
-
-#include "filter_avx.h"
-
-#elif defined(CPU_X86) && (defined(ENABLE_SSE2) || defined(ENABLE_SSE4))
-
-#if defined(ENABLE_SSE4)
-#include <smmintrin.h>
-#define mullo_epi32(a, b) _mm_mullo_epi32(a, b)
-#else // ENABLE_SSE2
-#include <emmintrin.h>
-#define mullo_epi32(a, b) \
-	_mm_unpacklo_epi32(_mm_shuffle_epi32(_mm_mul_epu32(a, b), 0xd8), \
-	_mm_shuffle_epi32(_mm_mul_epu32(_mm_shuffle_epi32(a, 0xb1), \
-	_mm_shuffle_epi32(b, 0xb1)), 0xd8))
-#endif // ENABLE_SSE4
-
-////////////////////////// hybrid_filter_sse4_dec ///////////////////////////
-/////////////////////////////////////////////////////////////////////////////
-
-static __inline void hybrid_filter_dec(TTA_fltst *fs, int32_t *in) {
-	register int32_t *pA = fs->dl;
-	register int32_t *pB = fs->qm;
-	register int32_t *pM = fs->dx;
-	register int32_t sum = fs->round;
-	register __m128i xmA1, xmA2, xmB1, xmB2, xmM1, xmM2, xmDP;
-
-	xmA1 = _mm_load_si128((__m128i*)pA);
-	xmA2 = _mm_load_si128((__m128i*)(pA + 4));
-	xmB1 = _mm_load_si128((__m128i*)pB);
-	xmB2 = _mm_load_si128((__m128i*)(pB + 4));
-	xmM1 = _mm_load_si128((__m128i*)pM);
-	xmM2 = _mm_load_si128((__m128i*)(pM + 4));
-
-	if (fs->error < 0) {
-		xmB1 = _mm_sub_epi32(xmB1, xmM1);
-		xmB2 = _mm_sub_epi32(xmB2, xmM2);
-		_mm_store_si128((__m128i*)pB, xmB1);
-		_mm_store_si128((__m128i*)(pB + 4), xmB2);
-	} else if (fs->error > 0) {
-		xmB1 = _mm_add_epi32(xmB1, xmM1);
-		xmB2 = _mm_add_epi32(xmB2, xmM2);
-		_mm_store_si128((__m128i*)pB, xmB1);
-		_mm_store_si128((__m128i*)(pB + 4), xmB2);
-	}
-
-	xmDP = _mm_add_epi32(mullo_epi32(xmA1, xmB1), mullo_epi32(xmA2, xmB2));
-	xmDP = _mm_add_epi32(xmDP, _mm_unpackhi_epi64(xmDP, xmDP));
-	sum += _mm_cvtsi128_si32(xmDP) + _mm_cvtsi128_si32(_mm_shuffle_epi32(xmDP, 1));
-
-	xmM1 = _mm_or_si128(_mm_srli_si128(xmM1, 4), _mm_slli_si128(xmM2, 12));
-	xmA1 = _mm_or_si128(_mm_srli_si128(xmA1, 4), _mm_slli_si128(xmA2, 12));
-	xmM2 = _mm_andnot_si128(_mm_setr_epi32(0, 1, 1, 3),
-		_mm_or_si128(_mm_srai_epi32(xmA2, 30), _mm_setr_epi32(1, 2, 2, 4)));
-
-	_mm_store_si128((__m128i*)pA, xmA1);
-	_mm_store_si128((__m128i*)pM, xmM1);
-	_mm_store_si128((__m128i*)(pM + 4), xmM2);
-
-	fs->error = *in;
-	*in += (sum >> fs->shift);
-
-	xmA2 = _mm_sub_epi32(
-		_mm_sub_epi32(
-			_mm_sub_epi32(_mm_set1_epi32(*in), _mm_srli_si128(xmA2, 4)), 
-			_mm_srli_si128(xmA2, 8)),
-		_mm_srli_si128(xmA2, 12));
-	_mm_store_si128((__m128i*)(pA + 4), xmA2);
-} // hybrid_filter_dec
-
-////////////////////////// hybrid_filter_sse4_enc ///////////////////////////
-/////////////////////////////////////////////////////////////////////////////
-
-static __inline void hybrid_filter_enc(TTA_fltst *fs, int32_t *in) {
-	register int32_t *pA = fs->dl;
-	register int32_t *pB = fs->qm;
-	register int32_t *pM = fs->dx;
-	register int32_t sum = fs->round;
-	register __m128i xmA1, xmA2, xmB1, xmB2, xmM1, xmM2, xmDP;
-
-	xmA1 = _mm_load_si128((__m128i*)pA);
-	xmA2 = _mm_load_si128((__m128i*)(pA + 4));
-	xmB1 = _mm_load_si128((__m128i*)pB);
-	xmB2 = _mm_load_si128((__m128i*)(pB + 4));
-	xmM1 = _mm_load_si128((__m128i*)pM);
-	xmM2 = _mm_load_si128((__m128i*)(pM + 4));
+#elif defined(CPU_X86)
 
-	if (fs->error < 0) {
-		xmB1 = _mm_sub_epi32(xmB1, xmM1);
-		xmB2 = _mm_sub_epi32(xmB2, xmM2);
-		_mm_store_si128((__m128i*)pB, xmB1);
-		_mm_store_si128((__m128i*)(pB + 4), xmB2);
-	} else if (fs->error > 0) {
-		xmB1 = _mm_add_epi32(xmB1, xmM1);
-		xmB2 = _mm_add_epi32(xmB2, xmM2);
-		_mm_store_si128((__m128i*)pB, xmB1);
-		_mm_store_si128((__m128i*)(pB + 4), xmB2);
-	}
-
-	xmDP = _mm_add_epi32(mullo_epi32(xmA1, xmB1), mullo_epi32(xmA2, xmB2));
-	xmDP = _mm_add_epi32(xmDP, _mm_unpackhi_epi64(xmDP, xmDP));
-	sum += _mm_cvtsi128_si32(xmDP) + _mm_cvtsi128_si32(_mm_shuffle_epi32(xmDP, 1));
-
-	xmM1 = _mm_or_si128(_mm_srli_si128(xmM1, 4), _mm_slli_si128(xmM2, 12));
-	xmA1 = _mm_or_si128(_mm_srli_si128(xmA1, 4), _mm_slli_si128(xmA2, 12));
-	xmM2 = _mm_andnot_si128(_mm_setr_epi32(0, 1, 1, 3),
-		_mm_or_si128(_mm_srai_epi32(xmA2, 30), _mm_setr_epi32(1, 2, 2, 4)));
-	
-	_mm_store_si128((__m128i*)pA, xmA1);
-	_mm_store_si128((__m128i*)pM, xmM1);
-	_mm_store_si128((__m128i*)(pM + 4), xmM2);
-
-	xmA2 = _mm_sub_epi32(
-		_mm_sub_epi32(
-			_mm_sub_epi32(_mm_set1_epi32(*in), _mm_srli_si128(xmA2, 4)), 
-			_mm_srli_si128(xmA2, 8)),
-		_mm_srli_si128(xmA2, 12));
-	_mm_store_si128((__m128i*)(pA + 4), xmA2);
-
-	*in -= (sum >> fs->shift);
-	fs->error = *in;
-} // hybrid_filter_enc
+// the kernels of all the x86 instruction sets are built into the library,
+// the best one supported by the cpu is selected at run time, see
+// filter_dispatch.h
+#undef CODEC_STATE_ALIGNMENT
+#define CODEC_STATE_ALIGNMENT 32 // avx
 
 #elif defined(__aarch64__) && defined(__APPLE__)
 
@@ -3,7 +3,8 @@
 #undef CODEC_STATE_ALIGNMENT
 #define CODEC_STATE_ALIGNMENT 32
 
-static __inline void hybrid_filter_dec(TTA_fltst *fs, int32_t *in) {
+TTA_TARGET("avx2")
+static __inline void hybrid_filter_avx_dec(TTA_fltst *fs, int32_t *in) {
 	int32_t *pA = fs->dl;
 	int32_t *pB = fs->qm;
 	int32_t *pM = fs->dx;
@@ -46,7 +47,8 @@ static __inline void hybrid_filter_dec(TTA_fltst *fs, int32_t *in) {
 	_mm256_store_si256((__m256i*)pA, xa);
 }
 
-static __inline void hybrid_filter_enc(TTA_fltst *fs, int32_t *in) {
+TTA_TARGET("avx2")
+static __inline void hybrid_filter_avx_enc(TTA_fltst *fs, int32_t *in) {
 	int32_t *pA = fs->dl;
 	int32_t *pB = fs->qm;
 	int32_t *pM = fs->dx;
@@ -0,0 +1,88 @@
+#include <immintrin.h>
+
+#undef CODEC_STATE_ALIGNMENT
+#define CODEC_STATE_ALIGNMENT 32
+
+// AVX-512VL on 256-bit registers: the sign of the previous error selects
+// the qm update through masks, valignd shifts the delay lines across the
+// whole register and the new taps are merged in by a masked blend.
+
+TTA_TARGET("avx2,avx512f,avx512vl")
+static __inline void hybrid_filter_avx512_dec(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i xa, xb, xm, xd, xe, xa1, xa2, xa3;
+	__m128i xdlo;
+
+	xa = _mm256_load_si256((__m256i*)pA);
+	xb = _mm256_load_si256((__m256i*)pB);
+	xm = _mm256_load_si256((__m256i*)pM);
+
+	xe = _mm256_set1_epi32(fs->error);
+	xb = _mm256_mask_sub_epi32(xb, _mm256_cmplt_epi32_mask(xe, zero), xb, xm);
+	xb = _mm256_mask_add_epi32(xb, _mm256_cmpgt_epi32_mask(xe, zero), xb, xm);
+	_mm256_store_si256((__m256i*)pB, xb);
+
+	xd = _mm256_mullo_epi32(xa, xb);
+	xdlo = _mm_add_epi32(_mm256_castsi256_si128(xd), _mm256_extracti128_si256(xd, 1));
+	xdlo = _mm_add_epi32(xdlo, _mm_unpackhi_epi64(xdlo, xdlo));
+	sum += _mm_cvtsi128_si32(xdlo) + _mm_extract_epi32(xdlo, 1);
+
+	xm = _mm256_mask_blend_epi32(0xf0, _mm256_alignr_epi32(xm, xm, 1),
+		_mm256_andnot_si256(_mm256_setr_epi32(0, 0, 0, 0, 0, 1, 1, 3),
+		_mm256_or_si256(_mm256_srai_epi32(xa, 30), _mm256_setr_epi32(0, 0, 0, 0, 1, 2, 2, 4))));
+	_mm256_store_si256((__m256i*)pM, xm);
+
+	fs->error = *in;
+	*in += (sum >> fs->shift);
+
+	xa1 = _mm256_alignr_epi32(zero, xa, 1);
+	xa2 = _mm256_alignr_epi32(zero, xa, 2);
+	xa3 = _mm256_alignr_epi32(zero, xa, 3);
+	xa = _mm256_mask_blend_epi32(0xf0, xa1, _mm256_sub_epi32(_mm256_sub_epi32(
+		_mm256_sub_epi32(_mm256_set1_epi32(*in), xa1), xa2), xa3));
+	_mm256_store_si256((__m256i*)pA, xa);
+}
+
+TTA_TARGET("avx2,avx512f,avx512vl")
+static __inline void hybrid_filter_avx512_enc(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i xa, xb, xm, xd, xe, xa1, xa2, xa3;
+	__m128i xdlo;
+
+	xa = _mm256_load_si256((__m256i*)pA);
+	xb = _mm256_load_si256((__m256i*)pB);
+	xm = _mm256_load_si256((__m256i*)pM);
+
+	xe = _mm256_set1_epi32(fs->error);
+	xb = _mm256_mask_sub_epi32(xb, _mm256_cmplt_epi32_mask(xe, zero), xb, xm);
+	xb = _mm256_mask_add_epi32(xb, _mm256_cmpgt_epi32_mask(xe, zero), xb, xm);
+	_mm256_store_si256((__m256i*)pB, xb);
+
+	xd = _mm256_mullo_epi32(xa, xb);
+	xdlo = _mm_add_epi32(_mm256_castsi256_si128(xd), _mm256_extracti128_si256(xd, 1));
+	xdlo = _mm_add_epi32(xdlo, _mm_unpackhi_epi64(xdlo, xdlo));
+	sum += _mm_cvtsi128_si32(xdlo) + _mm_extract_epi32(xdlo, 1);
+
+	xm = _mm256_mask_blend_epi32(0xf0, _mm256_alignr_epi32(xm, xm, 1),
+		_mm256_andnot_si256(_mm256_setr_epi32(0, 0, 0, 0, 0, 1, 1, 3),
+		_mm256_or_si256(_mm256_srai_epi32(xa, 30), _mm256_setr_epi32(0, 0, 0, 0, 1, 2, 2, 4))));
+	_mm256_store_si256((__m256i*)pM, xm);
+
+	xa1 = _mm256_alignr_epi32(zero, xa, 1);
+	xa2 = _mm256_alignr_epi32(zero, xa, 2);
+	xa3 = _mm256_alignr_epi32(zero, xa, 3);
+	xa = _mm256_mask_blend_epi32(0xf0, xa1, _mm256_sub_epi32(_mm256_sub_epi32(
+		_mm256_sub_epi32(_mm256_set1_epi32(*in), xa1), xa2), xa3));
+	_mm256_store_si256((__m256i*)pA, xa);
+
+	*in -= (sum >> fs->shift);
+	fs->error = *in;
+}
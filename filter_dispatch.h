@@ -0,0 +1,227 @@
+/*
+ * filter_dispatch.h
+ *
+ * Description: TTA hybrid filter selection at run time
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+#ifndef _FILTER_DISPATCH_H
+#define _FILTER_DISPATCH_H
+
+// A kernel set runs the filter and the fixed order 1 prediction over
+// whole columns (one channel) or lanes (see filter_lanes.h), so the
+// indirect call is paid once per frame pass and not per sample.
+typedef struct {
+	tta::cpu_arch arch;
+	void (*column_dec)(TTA_fltst *fs, int32_t *prev, int32_t *in,
+		uint32_t count, uint32_t stride);
+	void (*column_enc)(TTA_fltst *fs, int32_t *prev, int32_t *in,
+		uint32_t count, uint32_t stride);
+	void (*lanes_dec)(TTA_fltst_lanes<TTA_LANES> *fs, int32_t *in,
+		uint32_t count, uint32_t lanes);
+	void (*lanes_enc)(TTA_fltst_lanes<TTA_LANES> *fs, int32_t *in,
+		uint32_t count, uint32_t lanes);
+} TTA_kernels;
+
+// portable
+#define KERNEL_NAME(x) hybrid_filter_compat_##x
+#define KERNEL_ARCH tta::cpu_arch::UNKNOWN
+#include "filter_kernels.h"
+
+#if defined(__GNUC__)
+
+// portable, generic vectors
+#include "filter_vector.h"
+#define KERNEL_NAME(x) hybrid_filter_vector_##x
+#define KERNEL_LANE_BLOCK 4
+#define KERNEL_LANE_VECTOR
+#define KERNEL_ARCH tta::cpu_arch::PORTABLE_SIMD
+#include "filter_kernels.h"
+
+#endif // __GNUC__
+
+#if defined(CPU_X86)
+
+#if defined(__GNUC__)
+#include <cpuid.h>
+#else // MSVC
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+// SSE2
+#define KERNEL_NAME(x) hybrid_filter_sse2_##x
+#define KERNEL_TARGET "sse2"
+#define KERNEL_LANE_BLOCK 4
+#define KERNEL_ARCH tta::cpu_arch::IX86_SSE2
+#define mullo_epi32(a, b) \
+	_mm_unpacklo_epi32(_mm_shuffle_epi32(_mm_mul_epu32(a, b), 0xd8), \
+	_mm_shuffle_epi32(_mm_mul_epu32(_mm_shuffle_epi32(a, 0xb1), \
+	_mm_shuffle_epi32(b, 0xb1)), 0xd8))
+#define sign_epi32(a, b) \
+	_mm_sub_epi32(_mm_and_si128(a, _mm_cmpgt_epi32(b, _mm_setzero_si128())), \
+	_mm_and_si128(a, _mm_cmplt_epi32(b, _mm_setzero_si128())))
+#include "filter_sse.h"
+#include "filter_kernels.h"
+#undef mullo_epi32
+#undef sign_epi32
+
+// SSE4.1
+#define KERNEL_NAME(x) hybrid_filter_sse4_##x
+#define KERNEL_TARGET "sse4.1"
+#define KERNEL_LANE_BLOCK 4
+#define KERNEL_ARCH tta::cpu_arch::IX86_SSE4_1
+#define mullo_epi32(a, b) _mm_mullo_epi32(a, b)
+#define sign_epi32(a, b) _mm_sign_epi32(a, b)
+#include "filter_sse.h"
+#include "filter_kernels.h"
+#undef mullo_epi32
+#undef sign_epi32
+
+// AVX2
+#include "filter_avx.h"
+#define KERNEL_NAME(x) hybrid_filter_avx_##x
+#define KERNEL_TARGET "avx2"
+#define KERNEL_LANE_BLOCK 8
+#define KERNEL_ARCH tta::cpu_arch::IX86_AVX
+#include "filter_kernels.h"
+
+// AVX-512VL
+#include "filter_avx512.h"
+#define KERNEL_NAME(x) hybrid_filter_avx512_##x
+#define KERNEL_TARGET "avx2,avx512f,avx512vl"
+#define KERNEL_LANE_BLOCK 8
+#define KERNEL_ARCH tta::cpu_arch::IX86_AVX512
+#include "filter_kernels.h"
+
+static const TTA_kernels *const filter_kernel_sets[] = {
+	&hybrid_filter_compat_kernels,
+#if defined(__GNUC__)
+	&hybrid_filter_vector_kernels,
+#endif
+	&hybrid_filter_sse2_kernels,
+	&hybrid_filter_sse4_kernels,
+	&hybrid_filter_avx_kernels,
+	&hybrid_filter_avx512_kernels
+};
+
+static __inline void filter_cpuid(uint32_t leaf, uint32_t *r) {
+#if defined(__GNUC__)
+	__cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+#else // MSVC
+	__cpuidex((int *) r, leaf, 0);
+#endif
+} // filter_cpuid
+
+static __inline uint64_t filter_xgetbv() {
+#if defined(__GNUC__)
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t) hi << 32) | lo;
+#else // MSVC
+	return _xgetbv(0);
+#endif
+} // filter_xgetbv
+
+// the best instruction set supported by both the cpu and the os
+static tta::cpu_arch filter_cpu_arch() {
+	uint32_t r[4], leaves, ecx;
+	uint64_t xcr0 = 0;
+
+	filter_cpuid(0, r);
+	leaves = r[0];
+	filter_cpuid(1, r);
+	ecx = r[2];
+
+	if (!(r[3] & (1 << 26))) // SSE2
+		return tta::cpu_arch::UNKNOWN;
+	if (!(ecx & (1 << 19))) // SSE4.1
+		return tta::cpu_arch::IX86_SSE2;
+
+	if (ecx & (1 << 27)) // OSXSAVE
+		xcr0 = filter_xgetbv();
+	if (!(ecx & (1 << 28)) || (xcr0 & 0x6) != 0x6 || leaves < 7) // AVX
+		return tta::cpu_arch::IX86_SSE4_1;
+
+	filter_cpuid(7, r);
+	if (!(r[1] & (1 << 5))) // AVX2
+		return tta::cpu_arch::IX86_SSE4_1;
+	if (!(r[1] & (1 << 16)) || !(r[1] & (1u << 31)) || // AVX-512F, VL
+		(xcr0 & 0xe6) != 0xe6)
+		return tta::cpu_arch::IX86_AVX;
+
+	return tta::cpu_arch::IX86_AVX512;
+} // filter_cpu_arch
+
+#elif (defined(CPU_ARM) && defined(ENABLE_ASM)) || \
+	(defined(__aarch64__) && defined(__APPLE__))
+
+#define KERNEL_NAME(x) hybrid_filter_##x
+#if defined(CPU_ARM) && defined(ENABLE_ASM)
+#define KERNEL_ARCH tta::cpu_arch::ARM
+#else
+#define KERNEL_ARCH tta::cpu_arch::AARCH64
+#endif
+#include "filter_kernels.h"
+
+static const TTA_kernels *const filter_kernel_sets[] = {
+	&hybrid_filter_compat_kernels,
+#if defined(__GNUC__)
+	&hybrid_filter_vector_kernels,
+#endif
+	&hybrid_filter_kernels
+};
+
+static __inline tta::cpu_arch filter_cpu_arch() {
+	return hybrid_filter_kernels.arch;
+} // filter_cpu_arch
+
+#else // PORTABLE
+
+static const TTA_kernels *const filter_kernel_sets[] = {
+	&hybrid_filter_compat_kernels,
+#if defined(__GNUC__)
+	&hybrid_filter_vector_kernels
+#endif
+};
+
+static __inline tta::cpu_arch filter_cpu_arch() {
+	return filter_kernel_sets[sizeof(filter_kernel_sets) /
+		sizeof(filter_kernel_sets[0]) - 1]->arch;
+} // filter_cpu_arch
+
+#endif // PORTABLE
+
+// the kernel set of the given instruction set, nullptr if the set
+// is not built in or not supported by the cpu; the portable sets
+// run everywhere
+static __inline const TTA_kernels *filter_kernels_find(tta::cpu_arch arch) {
+	const TTA_kernels *ks = nullptr;
+
+	if (arch != tta::cpu_arch::UNKNOWN &&
+		arch != tta::cpu_arch::PORTABLE_SIMD &&
+		arch > filter_cpu_arch())
+		return nullptr;
+
+	for (const TTA_kernels *k : filter_kernel_sets)
+		if (k->arch == arch) ks = k;
+
+	return ks;
+} // filter_kernels_find
+
+// the best kernel set supported by the cpu
+static __inline const TTA_kernels *filter_kernels_best() {
+	const TTA_kernels *ks = filter_kernel_sets[0];
+	tta::cpu_arch arch = filter_cpu_arch();
+
+	for (const TTA_kernels *k : filter_kernel_sets)
+		if (k->arch <= arch) ks = k;
+
+	return ks;
+} // filter_kernels_best
+
+#endif // _FILTER_DISPATCH_H
@@ -0,0 +1,290 @@
+/*
+ * filter_kernels.h
+ *
+ * Description: TTA hybrid filter kernel sets
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+// Included once per kernel set, see filter_dispatch.h. The set is built
+// from the hybrid filter of one sample, KERNEL_NAME(dec) and KERNEL_NAME(enc),
+// and described by the macros:
+//   KERNEL_NAME(x)     names the functions of the set
+//   KERNEL_TARGET      instruction set of the functions (optional)
+//   KERNEL_LANE_BLOCK  lanes per vector register, 4 or 8 (optional, the
+//                      lanes run the portable code without it); the 4 lane
+//                      block takes mullo_epi32 and sign_epi32 of the set
+//   KERNEL_LANE_VECTOR the lanes use the generic vectors of filter_vector.h
+//                      instead of the x86 intrinsics (4 lanes per block)
+//   KERNEL_ARCH        the cpu_arch of the set
+// All of them are undefined at the end.
+
+#if defined(KERNEL_TARGET)
+#define KERNEL_FUNC TTA_TARGET(KERNEL_TARGET) static
+#else
+#define KERNEL_FUNC static
+#endif
+
+//////////////////////// hybrid_filter_column_dec ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// 'count' samples of one channel, stored 'stride' samples apart
+KERNEL_FUNC void KERNEL_NAME(column_dec)(TTA_fltst *fs, int32_t *prev,
+	int32_t *in, uint32_t count, uint32_t stride) {
+	for (; count; count--, in += stride) {
+		// decompress stage 1: adaptive hybrid filter
+		KERNEL_NAME(dec)(fs, in);
+		// decompress stage 2: fixed order 1 prediction
+		*in += ((*prev * 31) >> 5);
+		*prev = *in;
+	}
+} // hybrid_filter_column_dec
+
+//////////////////////// hybrid_filter_column_enc ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+KERNEL_FUNC void KERNEL_NAME(column_enc)(TTA_fltst *fs, int32_t *prev,
+	int32_t *in, uint32_t count, uint32_t stride) {
+	int32_t temp;
+
+	for (; count; count--, in += stride) {
+		// compress stage 1: fixed order 1 prediction
+		temp = *in;
+		*in -= ((*prev * 31) >> 5);
+		*prev = temp;
+		// compress stage 2: adaptive hybrid filter
+		KERNEL_NAME(enc)(fs, in);
+	}
+} // hybrid_filter_column_enc
+
+#if defined(KERNEL_LANE_BLOCK)
+
+#if defined(KERNEL_LANE_VECTOR)
+
+#define xmi TTA_v4si
+#define xms int32_t
+#define xm_shift(x) (x)
+#define xm_load(p) (*(TTA_v4si *)(p))
+#define xm_store(p, a) (*(TTA_v4si *)(p) = (a))
+#define xm_loadu(p) vec_loadu(p)
+#define xm_storeu(p, a) vec_storeu(p, a)
+#define xm_set1(x) TTA_v4si { x, x, x, x }
+#define xm_add(a, b) ((a) + (b))
+#define xm_sub(a, b) ((a) - (b))
+#define xm_or(a, b) ((a) | (b))
+#define xm_andnot(a, b) (~(a) & (b))
+#define xm_mullo(a, b) ((a) * (b))
+#define xm_sign(a, b) \
+	(((a) & ((b) > TTA_v4si {})) - ((a) & ((b) < TTA_v4si {})))
+#define xm_slli(a, n) ((a) << (n))
+#define xm_srai(a, n) ((a) >> (n))
+#define xm_sra(a, n) ((a) >> (n))
+
+#elif KERNEL_LANE_BLOCK == 8
+
+#define xmi __m256i
+#define xms __m128i
+#define xm_shift(x) _mm_cvtsi32_si128(x)
+#define xm_load(p) _mm256_load_si256((__m256i*)(p))
+#define xm_store(p, a) _mm256_store_si256((__m256i*)(p), a)
+#define xm_loadu(p) _mm256_loadu_si256((__m256i*)(p))
+#define xm_storeu(p, a) _mm256_storeu_si256((__m256i*)(p), a)
+#define xm_set1(x) _mm256_set1_epi32(x)
+#define xm_add(a, b) _mm256_add_epi32(a, b)
+#define xm_sub(a, b) _mm256_sub_epi32(a, b)
+#define xm_or(a, b) _mm256_or_si256(a, b)
+#define xm_andnot(a, b) _mm256_andnot_si256(a, b)
+#define xm_mullo(a, b) _mm256_mullo_epi32(a, b)
+#define xm_sign(a, b) _mm256_sign_epi32(a, b)
+#define xm_slli(a, n) _mm256_slli_epi32(a, n)
+#define xm_srai(a, n) _mm256_srai_epi32(a, n)
+#define xm_sra(a, n) _mm256_sra_epi32(a, n)
+
+#else // KERNEL_LANE_BLOCK == 4
+
+#define xmi __m128i
+#define xms __m128i
+#define xm_shift(x) _mm_cvtsi32_si128(x)
+#define xm_load(p) _mm_load_si128((__m128i*)(p))
+#define xm_store(p, a) _mm_store_si128((__m128i*)(p), a)
+#define xm_loadu(p) _mm_loadu_si128((__m128i*)(p))
+#define xm_storeu(p, a) _mm_storeu_si128((__m128i*)(p), a)
+#define xm_set1(x) _mm_set1_epi32(x)
+#define xm_add(a, b) _mm_add_epi32(a, b)
+#define xm_sub(a, b) _mm_sub_epi32(a, b)
+#define xm_or(a, b) _mm_or_si128(a, b)
+#define xm_andnot(a, b) _mm_andnot_si128(a, b)
+#define xm_mullo(a, b) mullo_epi32(a, b)
+#define xm_sign(a, b) sign_epi32(a, b)
+#define xm_slli(a, n) _mm_slli_epi32(a, n)
+#define xm_srai(a, n) _mm_srai_epi32(a, n)
+#define xm_sra(a, n) _mm_sra_epi32(a, n)
+
+#endif // KERNEL_LANE_BLOCK
+
+// the filter state of a block of lanes stays in registers for the whole run,
+// so the delay line shifts are register moves
+#define LANES_LOAD_STATE(fs, b) \
+	for (i = 0; i < 8; i++) { \
+		qm[i] = xm_load(&fs->qm[i][b]); \
+		dx[i] = xm_load(&fs->dx[i][b]); \
+		dl[i] = xm_load(&fs->dl[i][b]); \
+	} \
+	err = xm_load(&fs->error[b]); \
+	prev = xm_load(&fs->prev[b]);
+
+#define LANES_STORE_STATE(fs, b) \
+	for (i = 0; i < 8; i++) { \
+		xm_store(&fs->qm[i][b], qm[i]); \
+		xm_store(&fs->dx[i][b], dx[i]); \
+		xm_store(&fs->dl[i][b], dl[i]); \
+	} \
+	xm_store(&fs->error[b], err); \
+	xm_store(&fs->prev[b], prev);
+
+// qm += sign(error) * dx, sum = round + dl * qm, shift the delay lines
+#define LANES_FILTER_STEP() \
+	sum = round; \
+	for (i = 0; i < 8; i++) { \
+		qm[i] = xm_add(qm[i], xm_sign(dx[i], err)); \
+		sum = xm_add(sum, xm_mullo(dl[i], qm[i])); \
+	} \
+	for (i = 0; i < 4; i++) { \
+		dx[i] = dx[i + 1]; \
+		dl[i] = dl[i + 1]; \
+	} \
+	dx[4] = xm_or(xm_srai(dl[4], 30), xm_set1(1)); \
+	dx[5] = xm_andnot(xm_set1(1), xm_or(xm_srai(dl[5], 30), xm_set1(2))); \
+	dx[6] = xm_andnot(xm_set1(1), xm_or(xm_srai(dl[6], 30), xm_set1(2))); \
+	dx[7] = xm_andnot(xm_set1(3), xm_or(xm_srai(dl[7], 30), xm_set1(4)));
+
+//////////////////////// hybrid_filter_lanes_block_dec ////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+KERNEL_FUNC __inline void KERNEL_NAME(lanes_block_dec)(
+	TTA_fltst_lanes<TTA_LANES> *fs, int b, int32_t *in, uint32_t count) {
+	xmi qm[8], dx[8], dl[8], err, prev, sum, v, d5, d6;
+	xmi round = xm_set1(fs->round);
+	xms shift = xm_shift(fs->shift);
+	int i;
+
+	LANES_LOAD_STATE(fs, b);
+
+	for (; count; count--, in += TTA_LANES) {
+		LANES_FILTER_STEP();
+
+		v = xm_loadu(in);
+		err = v;
+		v = xm_add(v, xm_sra(sum, shift));
+
+		d5 = dl[5]; d6 = dl[6];
+		dl[6] = xm_sub(v, dl[7]);
+		dl[7] = v;
+		dl[5] = xm_sub(dl[6], d6);
+		dl[4] = xm_sub(dl[5], d5);
+
+		// fixed order 1 prediction
+		v = xm_add(v, xm_srai(xm_sub(xm_slli(prev, 5), prev), 5));
+		prev = v;
+		xm_storeu(in, v);
+	}
+
+	LANES_STORE_STATE(fs, b);
+} // hybrid_filter_lanes_block_dec
+
+//////////////////////// hybrid_filter_lanes_block_enc ////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+KERNEL_FUNC __inline void KERNEL_NAME(lanes_block_enc)(
+	TTA_fltst_lanes<TTA_LANES> *fs, int b, int32_t *in, uint32_t count) {
+	xmi qm[8], dx[8], dl[8], err, prev, sum, v, d5, d6;
+	xmi round = xm_set1(fs->round);
+	xms shift = xm_shift(fs->shift);
+	int i;
+
+	LANES_LOAD_STATE(fs, b);
+
+	for (; count; count--, in += TTA_LANES) {
+		// fixed order 1 prediction
+		v = xm_loadu(in);
+		d5 = v;
+		v = xm_sub(v, xm_srai(xm_sub(xm_slli(prev, 5), prev), 5));
+		prev = d5;
+
+		LANES_FILTER_STEP();
+
+		d5 = dl[5]; d6 = dl[6];
+		dl[6] = xm_sub(v, dl[7]);
+		dl[7] = v;
+		dl[5] = xm_sub(dl[6], d6);
+		dl[4] = xm_sub(dl[5], d5);
+
+		v = xm_sub(v, xm_sra(sum, shift));
+		err = v;
+		xm_storeu(in, v);
+	}
+
+	LANES_STORE_STATE(fs, b);
+} // hybrid_filter_lanes_block_enc
+
+// only the blocks holding the first 'lanes' lanes are processed
+KERNEL_FUNC void KERNEL_NAME(lanes_dec)(TTA_fltst_lanes<TTA_LANES> *fs,
+	int32_t *in, uint32_t count, uint32_t lanes) {
+	for (int b = 0; b < (int) lanes; b += KERNEL_LANE_BLOCK)
+		KERNEL_NAME(lanes_block_dec)(fs, b, in + b, count);
+} // hybrid_filter_lanes_dec
+
+KERNEL_FUNC void KERNEL_NAME(lanes_enc)(TTA_fltst_lanes<TTA_LANES> *fs,
+	int32_t *in, uint32_t count, uint32_t lanes) {
+	for (int b = 0; b < (int) lanes; b += KERNEL_LANE_BLOCK)
+		KERNEL_NAME(lanes_block_enc)(fs, b, in + b, count);
+} // hybrid_filter_lanes_enc
+
+#undef LANES_LOAD_STATE
+#undef LANES_STORE_STATE
+#undef LANES_FILTER_STEP
+#undef xmi
+#undef xms
+#undef xm_shift
+#undef xm_load
+#undef xm_store
+#undef xm_loadu
+#undef xm_storeu
+#undef xm_set1
+#undef xm_add
+#undef xm_sub
+#undef xm_or
+#undef xm_andnot
+#undef xm_mullo
+#undef xm_sign
+#undef xm_slli
+#undef xm_srai
+#undef xm_sra
+
+#else // PORTABLE
+
+KERNEL_FUNC void KERNEL_NAME(lanes_dec)(TTA_fltst_lanes<TTA_LANES> *fs,
+	int32_t *in, uint32_t count, uint32_t lanes) {
+	hybrid_filter_lanes_compat_dec(fs, in, count);
+} // hybrid_filter_lanes_dec
+
+KERNEL_FUNC void KERNEL_NAME(lanes_enc)(TTA_fltst_lanes<TTA_LANES> *fs,
+	int32_t *in, uint32_t count, uint32_t lanes) {
+	hybrid_filter_lanes_compat_enc(fs, in, count);
+} // hybrid_filter_lanes_enc
+
+#endif // PORTABLE
+
+static const TTA_kernels KERNEL_NAME(kernels) = {
+	KERNEL_ARCH,
+	KERNEL_NAME(column_dec),
+	KERNEL_NAME(column_enc),
+	KERNEL_NAME(lanes_dec),
+	KERNEL_NAME(lanes_enc)
+};
+
+#undef KERNEL_FUNC
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANE_BLOCK
+#undef KERNEL_LANE_VECTOR
+#undef KERNEL_ARCH
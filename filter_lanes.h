@@ -0,0 +1,149 @@
+/*
+ * filter_lanes.h
+ *
+ * Description: TTA lane-parallel hybrid filter functions
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+#ifndef _FILTER_LANES_H
+#define _FILTER_LANES_H
+
+// The lane kernels advance N independent streams (frames, channels or
+// files) by one sample per step. The states are kept in structure-of-arrays
+// form, so each vector register holds one filter tap of N streams and no
+// horizontal reductions are needed. The samples are interleaved by lane:
+// in[t * N + lane]. All lanes share the filter shift (i.e. sample depth).
+// Besides the hybrid filter, the kernels apply the fixed order 1 predictor,
+// so they replace codec_state::decode/encode for all lanes at once.
+// The vector versions are built per instruction set by filter_kernels.h.
+
+#define TTA_LANES 8 // default count of lanes
+
+template<int N>
+struct TTA_ALIGNED(64) TTA_fltst_lanes {
+	int32_t qm[8][N];
+	int32_t dx[8][N];
+	int32_t dl[8][N];
+	int32_t error[N];
+	int32_t prev[N];
+	int32_t round;
+	int32_t shift;
+};
+
+template<int N>
+static __inline void hybrid_filter_lanes_init(TTA_fltst_lanes<N> *fs,
+	uint32_t lane, uint64_t data, int32_t shift) {
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		fs->qm[i][lane] = (int8_t)(data >> (i * 8));
+		fs->dx[i][lane] = 0;
+		fs->dl[i][lane] = 0;
+	}
+	fs->error[lane] = 0;
+	fs->prev[lane] = 0;
+	fs->shift = shift;
+	fs->round = 1 << (shift - 1);
+} // hybrid_filter_lanes_init
+
+////////////////////// hybrid_filter_lanes_compat_dec ///////////////////////
+/////////////////////////////////////////////////////////////////////////////
+template<int N>
+static __inline void hybrid_filter_lanes_compat_dec(TTA_fltst_lanes<N> *fs,
+	int32_t *in, uint32_t count) {
+	int32_t sum[N];
+	int i, l;
+
+	for (; count; count--, in += N) {
+		for (l = 0; l < N; l++) {
+			int32_t s = (fs->error[l] > 0) - (fs->error[l] < 0);
+			sum[l] = fs->round;
+			for (i = 0; i < 8; i++) {
+				fs->qm[i][l] += s * fs->dx[i][l];
+				sum[l] += fs->dl[i][l] * fs->qm[i][l];
+			}
+		}
+
+		for (i = 0; i < 4; i++) {
+			for (l = 0; l < N; l++) {
+				fs->dx[i][l] = fs->dx[i + 1][l];
+				fs->dl[i][l] = fs->dl[i + 1][l];
+			}
+		}
+
+		for (l = 0; l < N; l++) {
+			int32_t value = in[l];
+
+			fs->dx[4][l] = ((fs->dl[4][l] >> 30) | 1);
+			fs->dx[5][l] = ((fs->dl[5][l] >> 30) | 2) & ~1;
+			fs->dx[6][l] = ((fs->dl[6][l] >> 30) | 2) & ~1;
+			fs->dx[7][l] = ((fs->dl[7][l] >> 30) | 4) & ~3;
+
+			fs->error[l] = value;
+			value += (sum[l] >> fs->shift);
+
+			fs->dl[4][l] = -fs->dl[5][l]; fs->dl[5][l] = -fs->dl[6][l];
+			fs->dl[6][l] = value - fs->dl[7][l]; fs->dl[7][l] = value;
+			fs->dl[5][l] += fs->dl[6][l]; fs->dl[4][l] += fs->dl[5][l];
+
+			// fixed order 1 prediction
+			value += ((fs->prev[l] * 31) >> 5);
+			fs->prev[l] = value;
+			in[l] = value;
+		}
+	}
+} // hybrid_filter_lanes_compat_dec
+
+////////////////////// hybrid_filter_lanes_compat_enc ///////////////////////
+/////////////////////////////////////////////////////////////////////////////
+template<int N>
+static __inline void hybrid_filter_lanes_compat_enc(TTA_fltst_lanes<N> *fs,
+	int32_t *in, uint32_t count) {
+	int32_t sum[N];
+	int i, l;
+
+	for (; count; count--, in += N) {
+		for (l = 0; l < N; l++) {
+			int32_t s = (fs->error[l] > 0) - (fs->error[l] < 0);
+			sum[l] = fs->round;
+			for (i = 0; i < 8; i++) {
+				fs->qm[i][l] += s * fs->dx[i][l];
+				sum[l] += fs->dl[i][l] * fs->qm[i][l];
+			}
+		}
+
+		for (i = 0; i < 4; i++) {
+			for (l = 0; l < N; l++) {
+				fs->dx[i][l] = fs->dx[i + 1][l];
+				fs->dl[i][l] = fs->dl[i + 1][l];
+			}
+		}
+
+		for (l = 0; l < N; l++) {
+			int32_t value = in[l];
+
+			// fixed order 1 prediction
+			value -= ((fs->prev[l] * 31) >> 5);
+			fs->prev[l] = in[l];
+
+			fs->dx[4][l] = ((fs->dl[4][l] >> 30) | 1);
+			fs->dx[5][l] = ((fs->dl[5][l] >> 30) | 2) & ~1;
+			fs->dx[6][l] = ((fs->dl[6][l] >> 30) | 2) & ~1;
+			fs->dx[7][l] = ((fs->dl[7][l] >> 30) | 4) & ~3;
+
+			fs->dl[4][l] = -fs->dl[5][l]; fs->dl[5][l] = -fs->dl[6][l];
+			fs->dl[6][l] = value - fs->dl[7][l]; fs->dl[7][l] = value;
+			fs->dl[5][l] += fs->dl[6][l]; fs->dl[4][l] += fs->dl[5][l];
+
+			value -= (sum[l] >> fs->shift);
+			fs->error[l] = value;
+			in[l] = value;
+		}
+	}
+} // hybrid_filter_lanes_compat_enc
+
+#endif // _FILTER_LANES_H
@@ -0,0 +1,123 @@
+/*
+ * filter_sse.h
+ *
+ * Description: TTA hybrid filter functions, SSE2 and SSE4 versions
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * SSE4 optimization copyright (c) 2008 Kazuki Oikawa
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+// Included once per instruction set, see filter_dispatch.h. KERNEL_NAME(x)
+// names the functions, KERNEL_TARGET is the instruction set and
+// mullo_epi32 the 32-bit multiplication available in it.
+
+////////////////////////// hybrid_filter_sse4_dec ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+TTA_TARGET(KERNEL_TARGET)
+static __inline void KERNEL_NAME(dec)(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	__m128i xmA1, xmA2, xmB1, xmB2, xmM1, xmM2, xmDP;
+
+	xmA1 = _mm_load_si128((__m128i*)pA);
+	xmA2 = _mm_load_si128((__m128i*)(pA + 4));
+	xmB1 = _mm_load_si128((__m128i*)pB);
+	xmB2 = _mm_load_si128((__m128i*)(pB + 4));
+	xmM1 = _mm_load_si128((__m128i*)pM);
+	xmM2 = _mm_load_si128((__m128i*)(pM + 4));
+
+	if (fs->error < 0) {
+		xmB1 = _mm_sub_epi32(xmB1, xmM1);
+		xmB2 = _mm_sub_epi32(xmB2, xmM2);
+		_mm_store_si128((__m128i*)pB, xmB1);
+		_mm_store_si128((__m128i*)(pB + 4), xmB2);
+	} else if (fs->error > 0) {
+		xmB1 = _mm_add_epi32(xmB1, xmM1);
+		xmB2 = _mm_add_epi32(xmB2, xmM2);
+		_mm_store_si128((__m128i*)pB, xmB1);
+		_mm_store_si128((__m128i*)(pB + 4), xmB2);
+	}
+
+	xmDP = _mm_add_epi32(mullo_epi32(xmA1, xmB1), mullo_epi32(xmA2, xmB2));
+	xmDP = _mm_add_epi32(xmDP, _mm_unpackhi_epi64(xmDP, xmDP));
+	sum += _mm_cvtsi128_si32(xmDP) + _mm_cvtsi128_si32(_mm_shuffle_epi32(xmDP, 1));
+
+	xmM1 = _mm_or_si128(_mm_srli_si128(xmM1, 4), _mm_slli_si128(xmM2, 12));
+	xmA1 = _mm_or_si128(_mm_srli_si128(xmA1, 4), _mm_slli_si128(xmA2, 12));
+	xmM2 = _mm_andnot_si128(_mm_setr_epi32(0, 1, 1, 3),
+		_mm_or_si128(_mm_srai_epi32(xmA2, 30), _mm_setr_epi32(1, 2, 2, 4)));
+
+	_mm_store_si128((__m128i*)pA, xmA1);
+	_mm_store_si128((__m128i*)pM, xmM1);
+	_mm_store_si128((__m128i*)(pM + 4), xmM2);
+
+	fs->error = *in;
+	*in += (sum >> fs->shift);
+
+	xmA2 = _mm_sub_epi32(
+		_mm_sub_epi32(
+			_mm_sub_epi32(_mm_set1_epi32(*in), _mm_srli_si128(xmA2, 4)),
+			_mm_srli_si128(xmA2, 8)),
+		_mm_srli_si128(xmA2, 12));
+	_mm_store_si128((__m128i*)(pA + 4), xmA2);
+} // hybrid_filter_sse4_dec
+
+////////////////////////// hybrid_filter_sse4_enc ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+TTA_TARGET(KERNEL_TARGET)
+static __inline void KERNEL_NAME(enc)(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	__m128i xmA1, xmA2, xmB1, xmB2, xmM1, xmM2, xmDP;
+
+	xmA1 = _mm_load_si128((__m128i*)pA);
+	xmA2 = _mm_load_si128((__m128i*)(pA + 4));
+	xmB1 = _mm_load_si128((__m128i*)pB);
+	xmB2 = _mm_load_si128((__m128i*)(pB + 4));
+	xmM1 = _mm_load_si128((__m128i*)pM);
+	xmM2 = _mm_load_si128((__m128i*)(pM + 4));
+
+	if (fs->error < 0) {
+		xmB1 = _mm_sub_epi32(xmB1, xmM1);
+		xmB2 = _mm_sub_epi32(xmB2, xmM2);
+		_mm_store_si128((__m128i*)pB, xmB1);
+		_mm_store_si128((__m128i*)(pB + 4), xmB2);
+	} else if (fs->error > 0) {
+		xmB1 = _mm_add_epi32(xmB1, xmM1);
+		xmB2 = _mm_add_epi32(xmB2, xmM2);
+		_mm_store_si128((__m128i*)pB, xmB1);
+		_mm_store_si128((__m128i*)(pB + 4), xmB2);
+	}
+
+	xmDP = _mm_add_epi32(mullo_epi32(xmA1, xmB1), mullo_epi32(xmA2, xmB2));
+	xmDP = _mm_add_epi32(xmDP, _mm_unpackhi_epi64(xmDP, xmDP));
+	sum += _mm_cvtsi128_si32(xmDP) + _mm_cvtsi128_si32(_mm_shuffle_epi32(xmDP, 1));
+
+	xmM1 = _mm_or_si128(_mm_srli_si128(xmM1, 4), _mm_slli_si128(xmM2, 12));
+	xmA1 = _mm_or_si128(_mm_srli_si128(xmA1, 4), _mm_slli_si128(xmA2, 12));
+	xmM2 = _mm_andnot_si128(_mm_setr_epi32(0, 1, 1, 3),
+		_mm_or_si128(_mm_srai_epi32(xmA2, 30), _mm_setr_epi32(1, 2, 2, 4)));
+
+	_mm_store_si128((__m128i*)pA, xmA1);
+	_mm_store_si128((__m128i*)pM, xmM1);
+	_mm_store_si128((__m128i*)(pM + 4), xmM2);
+
+	xmA2 = _mm_sub_epi32(
+		_mm_sub_epi32(
+			_mm_sub_epi32(_mm_set1_epi32(*in), _mm_srli_si128(xmA2, 4)),
+			_mm_srli_si128(xmA2, 8)),
+		_mm_srli_si128(xmA2, 12));
+	_mm_store_si128((__m128i*)(pA + 4), xmA2);
+
+	*in -= (sum >> fs->shift);
+	fs->error = *in;
+} // hybrid_filter_sse4_enc
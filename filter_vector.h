@@ -0,0 +1,119 @@
+/*
+ * filter_vector.h
+ *
+ * Description: TTA hybrid filter functions, generic vector version
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+#ifndef _FILTER_VECTOR_H
+#define _FILTER_VECTOR_H
+
+// Written with the GCC/Clang vector extensions, so the compiler maps it to
+// NEON, VSX, RVV or SSE, whatever the target has. The vectors are 128 bits
+// wide, the filter taps are kept in two halves.
+
+typedef int32_t TTA_v4si __attribute__((vector_size(16)));
+
+static __inline TTA_v4si vec_loadu(const int32_t *p) {
+	TTA_v4si v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+} // vec_loadu
+
+static __inline void vec_storeu(int32_t *p, TTA_v4si v) {
+	memcpy(p, &v, sizeof(v));
+} // vec_storeu
+
+////////////////////////// hybrid_filter_vector_dec ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static __inline void hybrid_filter_vector_dec(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	TTA_v4si xA1, xA2, xB1, xB2, xM1, xM2, xD, xV;
+
+	xA1 = *(TTA_v4si *) pA;
+	xA2 = *(TTA_v4si *)(pA + 4);
+	xB1 = *(TTA_v4si *) pB;
+	xB2 = *(TTA_v4si *)(pB + 4);
+	xM1 = *(TTA_v4si *) pM;
+	xM2 = *(TTA_v4si *)(pM + 4);
+
+	if (fs->error < 0) {
+		xB1 -= xM1;
+		xB2 -= xM2;
+	} else if (fs->error > 0) {
+		xB1 += xM1;
+		xB2 += xM2;
+	}
+	*(TTA_v4si *) pB = xB1;
+	*(TTA_v4si *)(pB + 4) = xB2;
+
+	xD = xA1 * xB1 + xA2 * xB2;
+	sum += xD[0] + xD[1] + xD[2] + xD[3];
+
+	*(TTA_v4si *) pM = TTA_v4si { xM1[1], xM1[2], xM1[3], xM2[0] };
+	*(TTA_v4si *) pA = TTA_v4si { xA1[1], xA1[2], xA1[3], xA2[0] };
+	*(TTA_v4si *)(pM + 4) = ((xA2 >> 30) | TTA_v4si { 1, 2, 2, 4 }) &
+		TTA_v4si { ~0, ~1, ~1, ~3 };
+
+	fs->error = *in;
+	*in += (sum >> fs->shift);
+
+	xV = TTA_v4si { *in, *in, *in, *in };
+	xV -= TTA_v4si { xA2[1], xA2[2], xA2[3], 0 };
+	xV -= TTA_v4si { xA2[2], xA2[3], 0, 0 };
+	xV -= TTA_v4si { xA2[3], 0, 0, 0 };
+	*(TTA_v4si *)(pA + 4) = xV;
+} // hybrid_filter_vector_dec
+
+////////////////////////// hybrid_filter_vector_enc ///////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static __inline void hybrid_filter_vector_enc(TTA_fltst *fs, int32_t *in) {
+	int32_t *pA = fs->dl;
+	int32_t *pB = fs->qm;
+	int32_t *pM = fs->dx;
+	int32_t sum = fs->round;
+	TTA_v4si xA1, xA2, xB1, xB2, xM1, xM2, xD, xV;
+
+	xA1 = *(TTA_v4si *) pA;
+	xA2 = *(TTA_v4si *)(pA + 4);
+	xB1 = *(TTA_v4si *) pB;
+	xB2 = *(TTA_v4si *)(pB + 4);
+	xM1 = *(TTA_v4si *) pM;
+	xM2 = *(TTA_v4si *)(pM + 4);
+
+	if (fs->error < 0) {
+		xB1 -= xM1;
+		xB2 -= xM2;
+	} else if (fs->error > 0) {
+		xB1 += xM1;
+		xB2 += xM2;
+	}
+	*(TTA_v4si *) pB = xB1;
+	*(TTA_v4si *)(pB + 4) = xB2;
+
+	xD = xA1 * xB1 + xA2 * xB2;
+	sum += xD[0] + xD[1] + xD[2] + xD[3];
+
+	*(TTA_v4si *) pM = TTA_v4si { xM1[1], xM1[2], xM1[3], xM2[0] };
+	*(TTA_v4si *) pA = TTA_v4si { xA1[1], xA1[2], xA1[3], xA2[0] };
+	*(TTA_v4si *)(pM + 4) = ((xA2 >> 30) | TTA_v4si { 1, 2, 2, 4 }) &
+		TTA_v4si { ~0, ~1, ~1, ~3 };
+
+	xV = TTA_v4si { *in, *in, *in, *in };
+	xV -= TTA_v4si { xA2[1], xA2[2], xA2[3], 0 };
+	xV -= TTA_v4si { xA2[2], xA2[3], 0, 0 };
+	xV -= TTA_v4si { xA2[3], 0, 0, 0 };
+	*(TTA_v4si *)(pA + 4) = xV;
+
+	*in -= (sum >> fs->shift);
+	fs->error = *in;
+} // hybrid_filter_vector_enc
+
+#endif // _FILTER_VECTOR_H
@@ -12,6 +12,23 @@
 #include "libtta.h"
 #include "config.h"
 #include "filter.h"
+#include "filter_lanes.h"
+#include "filter_dispatch.h"
+#include "crc32.h"
+#include "pcm.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && !defined(CARIBBEAN)
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 namespace tta {
 
@@ -45,52 +62,6 @@ const uint32_t bit_shift[] = {
 
 const uint32_t *shift_16 = bit_shift + 4;
 
-const uint32_t crc32_table[256] = {
-	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-	0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-	0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
-	0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-	0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
-	0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-	0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-	0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-	0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-	0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-	0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-	0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-	0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-	0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-	0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-	0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-	0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-	0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-	0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-	0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-	0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
-}; // crc32_table
-
 const uint32_t crc64_table_lo[256] = {
 	0x00000000, 0xa9ea3693, 0x53d46d26, 0xfa3e5bb5, 0x0e42ecdf, 0xa7a8da4c,
 	0x5d9681f9, 0xf47cb76a, 0x1c85d9be, 0xb56fef2d, 0x4f51b498, 0xe6bb820b,
@@ -194,46 +165,87 @@ const int32_t flt_set[3] = {10, 9, 10};
 #define ENC(x) ((x > 0)?((x << 1) - 1):(-x << 1))
 #define PREDICTOR1(x, k) ((x * ((1 << k) - 1)) >> k)
 
-#ifdef ENABLE_FRW // optimized, requires +3 bytes at the tail of the buffer
-#define READ_BUFFER(x, p, d, s) { \
-	x = *(int32_t *)p << s; \
-	p += d; }
-#define WRITE_BUFFER(x, p, d) { \
-	*(int32_t *)p = *x; \
-	p += d; }
-#else // not optimized, but accurate
-#define READ_BUFFER(x, p, d, s) { \
-	if (d == 2) x = *(int16_t *)p << s; \
-	else if (d == 1) x = *p << s; \
-	else x = *(int32_t *)p << s; \
-	p += d; }
-
-#define WRITE_BUFFER(x, p, d) { \
-	if (d == 2) *(int16_t *)p = 0xffff & *x; \
-	else if (d == 1) *p = 0xff & *x; \
-	else *(int32_t *)p = *x; \
-	p += d; }
+// the seek table entries reserved by the encoder of a stream of unknown
+// length without a bound of its length (about an hour), the unused ones
+// pad an id3v2 tag
+#define TTA_STREAM_FRAMES 3600
+#define TTA_STREAM_TAG_SIZE 27 // id3v2 header and TSSE frame
+
+// the sidecar seek index: "TTAI", version, count of frames, frame length,
+// data start position, the frame positions (frames + 1) and the crc32
+#define TTA_INDEX_MAGIC 0x49415454 // "TTAI"
+#define TTA_INDEX_VERSION 1
+#define TTA_INDEX_HEADER_SIZE 24
+#define TTA_RESYNC_RANGE 256 // min bytes searched around a frame start guess
+#define TTA_RESYNC_FRAMES 4 // frames searched after a corrupted one
+#define TTA_RESYNC_SCANS 64 // entropy passes tried per corrupted frame
+
+// alignment of the codec memory, for the filter lanes
+#define TTA_MEM_ALIGN 64
+
+// little endian load of 8 bytes from an unaligned address
+static __inline uint64_t read_le64(const uint8_t *p) {
+	uint64_t value;
+	tta_memcpy(&value, p, sizeof(value));
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+} // read_le64
+
+// little endian load of 4 bytes from an unaligned address
+static __inline uint32_t read_le32(const uint8_t *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+		((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+} // read_le32
+
+// little endian store of 8 bytes to an unaligned address
+static __inline void write_le64(uint8_t *p, uint64_t value) {
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	value = __builtin_bswap64(value);
 #endif
+	tta_memcpy(p, &value, sizeof(value));
+} // write_le64
+
+// count of trailing zero bits, x must not be 0
+static __inline uint32_t ctz64(uint64_t x) {
+#ifdef __GNUC__
+	return (uint32_t) __builtin_ctzll(x);
+#else // MSVC
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return (uint32_t) index;
+#endif
+} // ctz64
 
 /////////////////////////// TTA common functions ////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 
+// the filter kernels used by the native implementation
+static std::atomic<const TTA_kernels *> filter_native(filter_kernels_best());
+
 cpu_arch binary_version() {
-#if defined(CPU_ARM) && defined(ENABLE_ASM)
-	return cpu_arch::ARM;
-#elif defined(CPU_X86) && defined(ENABLE_AVX)
-	return cpu_arch::IX86_AVX;
-#elif defined(CPU_X86) && defined(ENABLE_SSE4)
-	return cpu_arch::IX86_SSE4_1;
-#elif defined(CPU_X86) && defined(ENABLE_SSE2)
-	return cpu_arch::IX86_SSE2;
-#elif defined(__aarch64__) && defined(__APPLE__)
-	return cpu_arch::AARCH64;
-#else
-	return cpu_arch::UNKNOWN;
-#endif
+	return filter_native.load(std::memory_order_relaxed)->arch;
 } // binary_version
 
+bool set_binary_version(cpu_arch arch) {
+	const TTA_kernels *ks = filter_kernels_find(arch);
+
+	if (ks == nullptr) return false;
+	filter_native.store(ks, std::memory_order_relaxed);
+
+	return true;
+} // set_binary_version
+
+// the filter kernels of the implementation type
+static __inline const TTA_kernels *filter_kernels(impl_type it) {
+	if (it == impl_type::native)
+		return filter_native.load(std::memory_order_relaxed);
+	if (it == impl_type::compat)
+		return &hybrid_filter_compat_kernels;
+	throw exception(error::UNSUPPORTED_ARCH);
+} // filter_kernels
+
 
 void compute_key_digits(void const *pstr, uint32_t len, uint64_t* out) {
 	int8_t *cstr = (int8_t *) pstr;
@@ -252,18 +264,20 @@ void compute_key_digits(void const *pstr, uint32_t len, uint64_t* out) {
 	*out = (((uint64_t) crc_hi) << 32) | ((uint64_t) crc_lo);
 } // compute_key_digits
 
-class codec_state
+class alignas(CODEC_STATE_ALIGNMENT) codec_state
 {
 public:
 	explicit codec_state() {}
 	virtual ~codec_state() {}
 	static void* operator new(size_t count);
 	static void* operator new[](size_t count);
+	static void operator delete(void* ptr);
+	static void operator delete[](void* ptr);
 	void init(uint64_t data, int32_t shift, uint32_t k0, uint32_t k1);
-	template<enum impl_type>
-	__inline void decode(int32_t* value);
-	template<enum impl_type>
-	__inline void encode(int32_t* value);
+	__inline void decode(const TTA_kernels *ks, int32_t *value,
+		uint32_t count, uint32_t stride);
+	__inline void encode(const TTA_kernels *ks, int32_t *value,
+		uint32_t count, uint32_t stride);
 	__inline uint32_t& k0() { return m_k[0]; }
 	__inline uint32_t& k1() { return m_k[1]; }
 	__inline uint32_t& sum0() { return m_sum[0]; }
@@ -283,6 +297,14 @@ void* codec_state::operator new[](size_t count) {
 	return ::operator new(count, std::align_val_t(CODEC_STATE_ALIGNMENT));
 }
 
+void codec_state::operator delete(void* ptr) {
+	::operator delete(ptr, std::align_val_t(CODEC_STATE_ALIGNMENT));
+}
+
+void codec_state::operator delete[](void* ptr) {
+	::operator delete(ptr, std::align_val_t(CODEC_STATE_ALIGNMENT));
+}
+
 void codec_state::init(uint64_t data, int32_t shift, uint32_t k0, uint32_t k1) {
 	tta_memclear(&m_fltst, sizeof(TTA_fltst));
 	m_fltst.shift = shift;
@@ -302,78 +324,402 @@ void codec_state::init(uint64_t data, int32_t shift, uint32_t k0, uint32_t k1) {
 	m_prev = 0;
 }
 
-template<>
-void codec_state::decode<impl_type::native>(int32_t* value) {
-	// decompress stage 1: adaptive hybrid filter
-	hybrid_filter_dec(&m_fltst, value);
-	// decompress stage 2: fixed order 1 prediction
-	*value += PREDICTOR1(m_prev, 5);
-	m_prev = *value;
+// filter a column of samples of the channel
+void codec_state::decode(const TTA_kernels *ks, int32_t *value,
+	uint32_t count, uint32_t stride) {
+	ks->column_dec(&m_fltst, &m_prev, value, count, stride);
 }
 
-template<>
-void codec_state::decode<impl_type::compat>(int32_t* value) {
-	// decompress stage 1: adaptive hybrid filter
-	hybrid_filter_compat_dec(&m_fltst, value);
-	// decompress stage 2: fixed order 1 prediction
-	*value += PREDICTOR1(m_prev, 5);
-	m_prev = *value;
+void codec_state::encode(const TTA_kernels *ks, int32_t *value,
+	uint32_t count, uint32_t stride) {
+	ks->column_enc(&m_fltst, &m_prev, value, count, stride);
 }
 
-template<>
-void codec_state::encode<impl_type::native>(int32_t* value) {
-	// compress stage 1: fixed order 1 prediction
-	int32_t temp = *value;
-	*value -= PREDICTOR1(m_prev, 5);
-	m_prev = temp;
-	// compress stage 2: adaptive hybrid filter
-	hybrid_filter_enc(&m_fltst, value);
+// filter states of all the channels for the frame pass
+class codec_lanes : public TTA_fltst_lanes<TTA_LANES> {};
+
+spanio::spanio(const uint8_t *data, uint64_t size) :
+	m_data(data), m_out(nullptr), m_size(size), m_pos(0), m_length(0) {}
+
+void spanio::assign(const uint8_t *data, uint64_t size) {
+	m_data = data;
+	m_out = nullptr;
+	m_size = size;
+	m_pos = 0;
+	m_length = 0;
 }
 
-template<>
-void codec_state::encode<impl_type::compat>(int32_t* value) {
-	// compress stage 1: fixed order 1 prediction
-	int32_t temp = *value;
-	*value -= PREDICTOR1(m_prev, 5);
-	m_prev = temp;
-	// compress stage 2: adaptive hybrid filter
-	hybrid_filter_compat_enc(&m_fltst, value);
+// the writer fills the span, the bytes past its end are not written
+void spanio::assign_output(uint8_t *data, uint64_t size) {
+	assign(nullptr, size);
+	m_out = data;
 }
 
+// the count of bytes written
+uint64_t spanio::length() const { return m_length; }
+
+// the writer reads back its output
+int32_t spanio::Read(uint8_t *buffer, uint32_t size) {
+	const uint8_t *data = m_out ? m_out : m_data;
+
+	if (!data) return 0;
+	if (size > m_size - m_pos) size = (uint32_t)(m_size - m_pos);
+	tta_memcpy(buffer, data + m_pos, size);
+	m_pos += size;
+	return size;
+}
+
+int32_t spanio::Write(uint8_t *buffer, uint32_t size) {
+	if (!m_out) return 0;
+	if (size > m_size - m_pos) size = (uint32_t)(m_size - m_pos);
+	tta_memcpy(m_out + m_pos, buffer, size);
+	m_pos += size;
+	if (m_length < m_pos) m_length = m_pos;
+	return size;
+}
+
+int64_t spanio::Seek(int64_t offset) {
+	if (offset < 0 || (uint64_t) offset > m_size) return -1;
+	m_pos = (uint64_t) offset;
+	return offset;
+}
+
+const uint8_t *spanio::Data(uint64_t *size) {
+	*size = m_size - m_pos;
+	return m_data ? m_data + m_pos : nullptr;
+}
+
+#if defined(__GNUC__) && !defined(CARIBBEAN)
+
+#define FDIO_ALIGN 4096 // O_DIRECT block alignment
+
+enum { FDIO_IDLE, FDIO_READ, FDIO_WRITE };
+
+fdio::fdio(int fd, uint32_t buffer_size, uint32_t flags) :
+	m_fd(fd), m_flags(flags), m_buffer(nullptr), m_pos(0), m_len(0),
+	m_offset(0), m_dropped(0), m_mode(FDIO_IDLE), m_seekable(false),
+	m_direct(false) {
+	void *buffer;
+	off_t pos;
+
+	m_size = (buffer_size + FDIO_ALIGN - 1) & ~(FDIO_ALIGN - 1);
+	if (!m_size) m_size = FDIO_ALIGN;
+	if (posix_memalign(&buffer, FDIO_ALIGN, m_size))
+		throw exception(error::MEMORY_INSUFFICIENT);
+	m_buffer = (uint8_t *) buffer;
+
+	// pipes are read and written in order, without the hints
+	pos = lseek(m_fd, 0, SEEK_CUR);
+	if (pos < 0) return;
+
+	m_seekable = true;
+	m_dropped = pos;
+	if (flags & FDIO_DIRECT) set_direct(true);
+	posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	locate(pos);
+}
+
+// leaves the descriptor at the current position
+fdio::~fdio() {
+	Flush();
+	if (m_seekable)
+		lseek(m_fd, m_offset + m_pos, SEEK_SET);
+	free(m_buffer);
+}
+
+void fdio::set_direct(bool on) {
+#if defined(O_DIRECT)
+	int fl = fcntl(m_fd, F_GETFL);
+
+	if (fl < 0) return;
+	fl = on ? (fl | O_DIRECT) : (fl & ~O_DIRECT);
+	if (!fcntl(m_fd, F_SETFL, fl) || !on) m_direct = on;
+#else
+	(void) on;
+#endif
+}
+
+// drops the pages of the range, the dirty ones once they are written
+void fdio::drop(uint64_t offset, uint64_t size) {
+	if (!(m_flags & (FDIO_DIRECT | FDIO_DONTNEED)) || !size)
+		return;
+#if defined(SYNC_FILE_RANGE_WRITE)
+	if (m_mode == FDIO_WRITE)
+		sync_file_range(m_fd, offset, size, SYNC_FILE_RANGE_WAIT_BEFORE |
+			SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+	posix_fadvise(m_fd, offset, size, POSIX_FADV_DONTNEED);
+}
+
+// the buffer starts at the block of 'pos' for O_DIRECT
+void fdio::locate(uint64_t pos) {
+	m_offset = m_direct ? (pos & ~(uint64_t)(FDIO_ALIGN - 1)) : pos;
+	m_pos = (uint32_t)(pos - m_offset);
+	m_len = 0;
+}
+
+bool fdio::fill() {
+	ssize_t res;
+
+	if (m_len) {
+		if (m_offset > m_dropped && m_offset - m_dropped >= m_size) {
+			drop(m_dropped, m_offset - m_dropped);
+			m_dropped = m_offset;
+		}
+		m_offset += m_len;
+		m_pos -= m_len;
+		m_len = 0;
+	}
+
+	while (1) {
+		res = m_seekable ? pread(m_fd, m_buffer, m_size, m_offset) :
+			read(m_fd, m_buffer, m_size);
+		if (res >= 0 || errno == EINTR) {
+			if (res >= 0) break;
+		} else if (errno == EINVAL && m_direct) {
+			set_direct(false); // O_DIRECT refused, use the page cache
+		} else break;
+	}
+	if (res <= 0) return false;
+	m_len = (uint32_t) res;
+
+	// the kernel reads the next part while this one is decoded
+	if (m_seekable && !m_direct)
+		posix_fadvise(m_fd, m_offset + m_len, m_size, POSIX_FADV_WILLNEED);
+
+	return m_pos < m_len;
+}
+
+bool fdio::write_all(const uint8_t *buffer, uint32_t size, uint64_t offset) {
+	ssize_t res;
+
+	while (size) {
+		res = m_seekable ? pwrite(m_fd, buffer, size, offset) :
+			write(m_fd, buffer, size);
+		if (res < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		buffer += res;
+		size -= (uint32_t) res;
+		offset += res;
+	}
+
+	return true;
+}
+
+// O_DIRECT takes the whole blocks from an aligned offset,
+// the rest goes through the page cache
+bool fdio::flush_buffer() {
+	uint32_t direct = 0;
+	bool ret = true, on = m_direct;
+
+	if (!m_pos) return true;
+
+	if (m_direct && !(m_offset & (FDIO_ALIGN - 1)))
+		direct = m_pos & ~(FDIO_ALIGN - 1);
+	if (direct && !write_all(m_buffer, direct, m_offset)) {
+		if (errno != EINVAL) return false;
+		set_direct(false); // O_DIRECT refused, use the page cache
+		direct = 0;
+		on = false;
+	}
+
+	if (m_pos > direct) {
+		if (on) set_direct(false);
+		ret = write_all(m_buffer + direct, m_pos - direct, m_offset + direct);
+		if (on) set_direct(true);
+	}
+
+	if (m_offset > m_dropped && m_offset - m_dropped >= m_size) {
+		drop(m_dropped, m_offset - m_dropped);
+		m_dropped = m_offset;
+	}
+
+	m_offset += m_pos;
+	m_pos = 0;
+
+	return ret;
+}
+
+int32_t fdio::Read(uint8_t *buffer, uint32_t size) {
+	uint32_t done = 0, len;
+
+	if (m_mode != FDIO_READ) {
+		if (!Flush()) return -1;
+		if (m_seekable) locate(m_offset + m_pos);
+		m_mode = FDIO_READ;
+	}
+
+	while (done < size) {
+		if (m_pos >= m_len && !fill())
+			break;
+
+		len = m_len - m_pos;
+		if (len > size - done) len = size - done;
+		tta_memcpy(buffer + done, m_buffer + m_pos, len);
+		m_pos += len;
+		done += len;
+	}
+
+	return done;
+}
+
+int32_t fdio::Write(uint8_t *buffer, uint32_t size) {
+	uint32_t done = 0, len;
+
+	if (m_mode != FDIO_WRITE) {
+		m_offset += m_pos;
+		m_pos = m_len = 0;
+		m_mode = FDIO_WRITE;
+	}
+
+	while (done < size) {
+		len = m_size - m_pos;
+		if (len > size - done) len = size - done;
+		tta_memcpy(m_buffer + m_pos, buffer + done, len);
+		m_pos += len;
+		done += len;
+
+		if (m_pos == m_size && !flush_buffer())
+			return -1;
+	}
+
+	return done;
+}
+
+int64_t fdio::Seek(int64_t offset) {
+	if (!m_seekable || offset < 0 || !Flush())
+		return -1;
+
+	// the buffer is written out, the next write starts a new one at
+	// the position (locate keeps the block head of it for O_DIRECT)
+	if (m_mode == FDIO_WRITE) m_mode = FDIO_IDLE;
+
+	// the reader keeps the buffer if the position is in it
+	if (m_mode == FDIO_READ && (uint64_t) offset >= m_offset &&
+		(uint64_t) offset < m_offset + m_len) {
+		m_pos = (uint32_t)(offset - m_offset);
+		return offset;
+	}
+
+	locate(offset);
+	return offset;
+}
+
+// writes out the buffer, false on a write error
+bool fdio::Flush() {
+	if (m_mode != FDIO_WRITE)
+		return true;
+	return flush_buffer();
+}
+
+#endif // __GNUC__
+
 bufio::bufio(fileio *io) :
+	m_buffer(m_fifo),
+	m_size(TTA_FIFO_BUFFER_SIZE),
 	m_pos(nullptr),
+	m_end(nullptr),
+	m_crc_pos(nullptr),
 	m_bcount(0),
 	m_bcache(0),
 	m_crc(0xffffffffUL),
 	m_count(0),
+	m_mapped(false),
 	m_io(io) {}
 
-bufio::~bufio() {}
+bufio::~bufio() {
+	if (m_buffer != m_fifo) tta_free(m_buffer);
+}
 
 void bufio::io(fileio* io) { m_io = io; }
 fileio* bufio::io() const { return m_io; }
 
-void bufio::reader_start() { m_pos = m_buffer+TTA_FIFO_BUFFER_SIZE; }
+// a larger buffer passes the data to the fileio in larger parts,
+// it is set before the reader or writer starts
+void bufio::buffer_size(uint32_t size) {
+	uint8_t *buffer = m_fifo;
+
+	if (size > TTA_FIFO_BUFFER_SIZE) {
+		buffer = (uint8_t *) tta_malloc((size + 8 + 15) & ~15);
+		if (buffer == NULL)
+			throw exception(error::MEMORY_INSUFFICIENT);
+	} else size = TTA_FIFO_BUFFER_SIZE;
+
+	if (m_buffer != m_fifo) tta_free(m_buffer);
+	m_buffer = buffer;
+	m_size = size;
+	m_pos = m_end = m_crc_pos = m_buffer;
+}
 
-void bufio::writer_start() { m_pos = m_buffer; }
+// the reader takes the data straight from the fileio if it is in memory,
+// only the last bytes are copied to the buffer for the padding
+void bufio::reader_start() {
+	uint64_t size;
+	const uint8_t *data = m_io->Data(&size);
+
+	m_mapped = (data != nullptr);
+	if (m_mapped) {
+		m_pos = m_crc_pos = (uint8_t *) data;
+		m_end = m_pos + size;
+	} else m_pos = m_end = m_crc_pos = m_buffer;
+}
+
+void bufio::writer_start() {
+	m_mapped = false;
+	m_pos = m_crc_pos = m_buffer;
+}
 
 void bufio::reset() {
 	// init crc32, reset counter
 	m_crc = 0xffffffffUL;
+	m_crc_pos = m_pos;
 	m_bcache = 0;
 	m_bcount = 0;
 	m_count = 0;
 }
 
+void bufio::update_crc() {
+	uint32_t size = (uint32_t)(m_pos - m_crc_pos);
+
+	// update crc32 and statistics of the data passed since the last update
+	m_crc = crc32_span(m_crc, m_crc_pos, size);
+	m_count += size;
+	m_crc_pos = m_pos;
+}
+
+void bufio::reader_fill() {
+	uint32_t size;
+	int32_t res;
+
+	update_crc();
+
+	// move the rest of data to the buffer start, keep at least
+	// 8 bytes for the wide loads unless the input is over
+	size = (uint32_t)(m_end - m_pos);
+	memmove(m_buffer, m_pos, size);
+	m_pos = m_crc_pos = m_buffer;
+	m_end = m_buffer + size;
+
+	// all the mapped data is in the window already
+	if (!m_mapped) do {
+		res = m_io->Read(m_end, m_size - size);
+		if (res > 0) {
+			m_end += res;
+			size += res;
+		}
+	} while (res > 0 && size < 8);
+
+	tta_memclear(m_end, 8); // padding
+}
+
 uint8_t bufio::read_byte() {
-	if (m_pos == m_buffer+TTA_FIFO_BUFFER_SIZE) {
-		if (!m_io->Read(m_buffer, TTA_FIFO_BUFFER_SIZE))
+	if (m_pos == m_end) {
+		reader_fill();
+		if (m_pos == m_end)
 			throw exception(error::READ_FILE);
-		m_pos = m_buffer;
 	}
-	// update crc32 and statistics
-	m_crc = crc32_table[(m_crc ^ *m_pos) & 0xff] ^ (m_crc >> 8);
-	m_count++;
 	return *m_pos++;
 }
 
@@ -394,12 +740,45 @@ uint32_t bufio::read_uint32() {
 }
 
 bool bufio::read_crc32() {
+	update_crc();
 	uint32_t crc = m_crc ^ 0xffffffffUL;
 	return (crc != read_uint32());
 }
 
 void bufio::reader_skip_bytes(uint32_t size) {
-	while (size--) read_byte();
+	uint32_t len;
+
+	while (size) {
+		if (m_pos == m_end) {
+			reader_fill();
+			if (m_pos == m_end)
+				throw exception(error::READ_FILE);
+		}
+		len = (uint32_t)(m_end - m_pos);
+		if (len > size) len = size;
+		m_pos += len;
+		size -= len;
+	}
+}
+
+// copies the next 'size' bytes of the stream, the bytes are not in crc
+void bufio::read_bytes(uint8_t *buffer, uint32_t size) {
+	uint32_t len;
+
+	while (size) {
+		if (m_pos == m_end) {
+			reader_fill();
+			if (m_pos == m_end)
+				throw exception(error::READ_FILE);
+		}
+		len = (uint32_t)(m_end - m_pos);
+		if (len > size) len = size;
+		tta_memcpy(buffer, m_pos, len);
+		m_pos += len;
+		m_crc_pos = m_pos;
+		buffer += len;
+		size -= len;
+	}
 }
 
 void bufio::writer_skip_bytes(uint32_t size) {
@@ -414,11 +793,12 @@ uint32_t bufio::skip_id3v2() {
 	if ('I' != read_byte() ||
 		'D' != read_byte() ||
 		'3' != read_byte()) {
-			m_pos = m_buffer;
+			m_pos = m_crc_pos; // back to the start
 			return 0;
 	}
 
-	m_pos += 2; // skip version bytes
+	read_byte(); // skip version bytes
+	read_byte();
 	if (read_byte() & 0x10) size += 10;
 
 	size += (read_byte() & 0x7f);
@@ -471,90 +851,87 @@ uint32_t bufio::write_tta_header(info *i) {
 	return 22; // sizeof TTA1 header
 }
 
-uint32_t bufio::count() const { return m_count; }
+uint32_t bufio::count() const { return m_count + (uint32_t)(m_pos - m_crc_pos); }
+
+// the next 64 bits of the stream, the bits of cache go first
+uint64_t bufio::peek_bits() {
+	if (m_end - m_pos < 8) reader_fill();
+	return m_bcache | (read_le64(m_pos) << m_bcount);
+}
+
+// drops count (<= 56) bits of the peeked ones, the bits left of
+// the last byte read stay in cache
+void bufio::skip_bits(uint64_t bits, uint32_t count) {
+	uint32_t bytes = (count + 7 - m_bcount) >> 3;
+
+	m_pos += bytes;
+	m_bcount = (bytes << 3) + m_bcount - count;
+	m_bcache = (uint32_t)(bits >> count) & bit_mask[m_bcount];
+
+	if (m_pos > m_end)
+		throw exception(error::READ_FILE);
+}
 
 int32_t bufio::get_value(codec_state& c) {
-	uint32_t k, level, tmp;
-	int32_t value = 0;
-
-	// decode Rice unsigned
-	if (!(m_bcache ^ bit_mask[m_bcount])) {
-		value += m_bcount;
-		m_bcache = read_byte();
-		m_bcount = 8;
-		while (m_bcache == 0xff) {
-			value += 8;
-			m_bcache = read_byte();
-		}
-	}
+	uint64_t bits = peek_bits();
+	uint32_t k, level, sum, unary;
+	uint32_t value = 0;
 
-	while (m_bcache & 1) {
-		value++;
-		m_bcache >>= 1;
-		m_bcount--;
+	// decode Rice unsigned, the unary part is a run of ones
+	while (!(~bits & 0x00ffffffffffffffULL)) {
+		value += 56;
+		skip_bits(bits, 56);
+		bits = peek_bits();
 	}
-	m_bcache >>= 1;
-	m_bcount--;
 
-	if (value) {
-		level = 1;
-		k = c.k1();
-		value--;
-	} else {
-		level = 0;
-		k = c.k0();
-	}
+	unary = ctz64(~bits);
+	value += unary;
+	unary++; // the terminating zero
 
-	if (k) {
-		while (m_bcount < k) {
-			tmp = read_byte();
-			m_bcache |= tmp << m_bcount;
-			m_bcount += 8;
-		}
-		value = (value << k) + (m_bcache & bit_mask[k]);
-		m_bcache >>= k;
-		m_bcount -= k;
-		m_bcache &= bit_mask[m_bcount];
-	}
+	level = (value != 0);
+	k = level ? c.k1() : c.k0();
+	value -= level;
 
-	if (level) {
-		c.sum1() += value - (c.sum1() >> 4);
-		if (c.k1() > 0 && c.sum1() < shift_16[c.k1()])
-			c.k1()--;
-		else if (c.sum1() > shift_16[c.k1() + 1])
-			c.k1()++;
-		value += bit_shift[c.k0()];
+	if (unary + k <= 56) {
+		value = (value << k) + (uint32_t)((bits >> unary) & ((1ULL << k) - 1));
+		skip_bits(bits, unary + k);
+	} else {
+		skip_bits(bits, unary);
+		bits = peek_bits();
+		value = (value << k) + (uint32_t)(bits & ((1ULL << k) - 1));
+		skip_bits(bits, k);
 	}
 
-	c.sum0() += value - (c.sum0() >> 4);
-	if (c.k0() > 0 && c.sum0() < shift_16[c.k0()])
-		c.k0()--;
-	else if (c.sum0() > shift_16[c.k0() + 1])
-	c.k0()++;
+	// adapt k1 (level 1 only) and k0, the adaptation steps can't
+	// both apply as shift_16 is ascending
+	k = c.k1();
+	sum = c.sum1() + value - (c.sum1() >> 4);
+	c.sum1() = level ? sum : c.sum1();
+	c.k1() = level ? k - ((k > 0) & (sum < shift_16[k])) + (sum > shift_16[k + 1]) : k;
+	value += level ? bit_shift[c.k0()] : 0;
 
-	value = DEC(value);
+	k = c.k0();
+	sum = c.sum0() + value - (c.sum0() >> 4);
+	c.sum0() = sum;
+	c.k0() = k - ((k > 0) & (sum < shift_16[k])) + (sum > shift_16[k + 1]);
 
-	return value;
+	int32_t result = (int32_t) value;
+	return DEC(result);
 }
 
 void bufio::writer_done() {
 	int32_t buffer_size = (int32_t)(m_pos - m_buffer);
 	if (buffer_size) {
+		update_crc();
 		if (m_io->Write(m_buffer, buffer_size) != buffer_size)
 			throw exception(error::WRITE_FILE);
-		m_pos = m_buffer;
+		m_pos = m_crc_pos = m_buffer;
 	}
 }
 
 void bufio::write_byte(uint32_t value) {
-	if (m_pos == m_buffer+TTA_FIFO_BUFFER_SIZE) {
-		if (m_io->Write(m_buffer, TTA_FIFO_BUFFER_SIZE) != TTA_FIFO_BUFFER_SIZE)
-			throw exception(error::WRITE_FILE);
-		m_pos = m_buffer;
-	}
-	// update crc32 and statistics
-	m_crc = crc32_table[(m_crc ^ value) & 0xff] ^ (m_crc >> 8);
-	m_count++;
+	if (m_pos >= m_buffer + m_size)
+		writer_done();
 	*m_pos++ = (value & 0xff);
 }
 
@@ -571,10 +948,26 @@ void bufio::write_uint32(uint32_t value) {
 } // write_uint32
 
 void bufio::write_crc32() {
+	update_crc();
 	uint32_t crc = m_crc ^ 0xffffffffUL;
 	write_uint32(crc);
 }
 
+// appends count (<= 56) bits to the cache and stores the whole
+// bytes of the cache at once
+void bufio::put_bits(uint64_t bits, uint32_t count) {
+	if (m_pos >= m_buffer + m_size)
+		writer_done();
+
+	m_bcache |= bits << m_bcount;
+	m_bcount += count;
+
+	write_le64(m_pos, m_bcache);
+	m_pos += m_bcount >> 3;
+	m_bcache >>= m_bcount & ~7;
+	m_bcount &= 7;
+}
+
 void bufio::put_value(codec_state& c, int32_t value) {
 	uint32_t k, unary, outval;
 
@@ -602,76 +995,334 @@ void bufio::put_value(codec_state& c, int32_t value) {
 		unary = 1 + (outval >> k);
 	} else unary = 0;
 
-	// put unary
-	do {
-		while (m_bcount >= 8) {
-			write_byte(m_bcache);
-			m_bcache >>= 8;
-			m_bcount -= 8;
-		}
-
-		if (unary > 23) {
-			m_bcache |= bit_mask[23] << m_bcount;
-			m_bcount += 23;
-			unary -= 23;
-		} else {
-			m_bcache |= bit_mask[unary] << m_bcount;
-			m_bcount += unary + 1;
-			unary = 0;
-		}
-	} while (unary);
-
-	// put binary
-	while (m_bcount >= 8) {
-		write_byte(m_bcache);
-		m_bcache >>= 8;
-		m_bcount -= 8;
+	// put unary, the long runs go in parts
+	while (unary > 32) {
+		put_bits(0xffffffffULL, 32);
+		unary -= 32;
 	}
 
-	if (k) {
-		m_bcache |= (outval & bit_mask[k]) << m_bcount;
-		m_bcount += k;
+	// put unary with the terminating zero and binary
+	if (unary + 1 + k <= 56) {
+		put_bits(((1ULL << unary) - 1) |
+			((outval & ((1ULL << k) - 1)) << (unary + 1)), unary + 1 + k);
+	} else {
+		put_bits((1ULL << unary) - 1, unary + 1);
+		put_bits(outval & ((1ULL << k) - 1), k);
 	}
 }
 
 void bufio::flush_bit_cache() {
-	while (m_bcount) {
-		write_byte(m_bcache);
-		m_bcache >>= 8;
-		m_bcount = (m_bcount > 8) ? (m_bcount - 8) : 0;
-	}
+	if (m_bcount)
+		write_byte((uint32_t) m_bcache);
+	m_bcache = 0;
+	m_bcount = 0;
 	write_crc32();
 }
 
-codec_base::codec_base(fileio* io) : m_codec(nullptr), m_data(0), m_bufio(io), seek_table(nullptr) {}
-codec_base::~codec_base() {
-	if (m_codec) delete[] m_codec;
-	if (seek_table) tta_free(seek_table);
+codec_base::codec_base(fileio* io) : m_codec(nullptr), m_data(0), m_bufio(io), seek_table(nullptr),
+	m_lanes(nullptr), m_frame(nullptr), m_stride(0), m_pass(nullptr),
+	m_format(sample_format::pcm), m_alloc(), m_capacity(0), m_codec_count(0),
+	m_frame_size(0) {}
+codec_base::~codec_base() { release(); }
+
+uint32_t codec_base::get_frame_length() const { return flen_std; }
+
+void codec_base::set_buffer_size(uint32_t size) { m_bufio.buffer_size(size); }
+
+// the memory allocated with the previous functions is released,
+// nullptr sets the default ones
+void codec_base::set_allocator(const allocator *a) {
+	release();
+	if (a) m_alloc = *a;
+	else m_alloc = allocator();
 }
 
+// the next stream is read or written through 'io', the init that follows
+// reuses the memory of the previous stream where it is large enough
+void codec_base::reopen(fileio *io) { m_bufio.io(io); }
 
-//////////////////////////// decoder functions //////////////////////////////
+void *codec_base::mem_alloc(size_t size) {
+	void *ptr;
+
+	size = (size + TTA_MEM_ALIGN - 1) & ~(size_t)(TTA_MEM_ALIGN - 1);
+	if (m_alloc.alloc)
+		ptr = m_alloc.alloc(m_alloc.opaque, size, TTA_MEM_ALIGN);
+	else ptr = ::operator new(size, std::align_val_t(TTA_MEM_ALIGN), std::nothrow);
+
+	if (ptr == NULL)
+		throw exception(error::MEMORY_INSUFFICIENT);
+	return ptr;
+}
+
+void codec_base::mem_free(void *ptr) {
+	if (!ptr) return;
+	if (m_alloc.free)
+		m_alloc.free(m_alloc.opaque, ptr);
+	else ::operator delete(ptr, std::align_val_t(TTA_MEM_ALIGN));
+}
+
+// the seek table of at least 'count' entries
+void codec_base::table_alloc(uint32_t count) {
+	if (!count) count = 1;
+	if (count <= m_capacity) return;
+
+	mem_free(seek_table);
+	seek_table = nullptr;
+	m_capacity = 0;
+
+	seek_table = (uint64_t *) mem_alloc((size_t) count * sizeof(uint64_t));
+	m_capacity = count;
+}
+
+// the codec states of 'nch' channels
+void codec_base::codec_alloc(uint32_t nch) {
+	uint32_t ch;
+
+	if (nch > m_codec_count) {
+		for (ch = 0; ch < m_codec_count; ch++)
+			m_codec[ch].~codec_state();
+		mem_free(m_codec);
+		m_codec = nullptr;
+		m_codec_count = 0;
+
+		m_codec = (codec_state *) mem_alloc(nch * sizeof(codec_state));
+		for (ch = 0; ch < nch; ch++)
+			::new (m_codec + ch) codec_state();
+		m_codec_count = nch;
+	}
+
+	m_codec_last = m_codec + nch - 1;
+}
+
+void codec_base::release() {
+	uint32_t ch;
+
+	for (ch = 0; ch < m_codec_count; ch++)
+		m_codec[ch].~codec_state();
+	mem_free(m_codec);
+	mem_free(seek_table);
+	mem_free(m_lanes);
+	mem_free(m_frame);
+
+	m_codec = nullptr;
+	seek_table = nullptr;
+	m_lanes = nullptr;
+	m_frame = nullptr;
+	m_capacity = m_codec_count = m_frame_size = 0;
+}
+
+///////////////////////// frame-parallel processing /////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 
-bool decoder::read_seek_table() {
-	uint64_t tmp;
-	uint32_t i;
+// fileio over a memory span (reader) or a growing buffer (writer),
+// feeds the per-thread bufio
+class memio : public spanio
+{
+private:
+	std::vector<uint8_t> *m_sink;
+public:
+	memio() : m_sink(nullptr) {}
 
-	if (!seek_table) return false;
+	void assign(const uint8_t *data, uint64_t size) {
+		spanio::assign(data, size);
+		m_sink = nullptr;
+	}
 
-	m_bufio.reset();
+	void assign(std::vector<uint8_t> *sink) {
+		assign(nullptr, 0);
+		m_sink = sink;
+	}
 
-	tmp = offset + (frames + 1) * 4;
-	for (i = 0; i < frames; i++) {
-		seek_table[i] = tmp;
-		tmp += m_bufio.read_uint32();
-	} 
+	int32_t Write(uint8_t *buffer, uint32_t size) override {
+		if (!m_sink) return 0;
+		m_sink->insert(m_sink->end(), buffer, buffer + size);
+		return size;
+	}
+};
+
+// entropy decoding of one frame, the residuals of channel c are stored
+// at res[t * stride + c]; stops after a whole sample once the limit of
+// bytes read is reached, returns the count of samples decoded
+template<uint32_t NCH>
+static uint32_t decode_frame_residuals(bufio &bio, codec_state *codec,
+	uint32_t nch, uint32_t flen, int32_t *res, uint32_t stride,
+	uint32_t limit) {
+	uint32_t fpos, ch;
+
+	if (NCH) nch = NCH;
+	for (fpos = 0; fpos < flen && bio.count() < limit; fpos++, res += stride)
+		for (ch = 0; ch < nch; ch++)
+			res[ch] = bio.get_value(codec[ch]);
+
+	return fpos;
+} // decode_frame_residuals
+
+// entropy encoding of 'flen' samples of a frame, the caller flushes
+// the bit cache and writes the crc at the end of the frame
+template<uint32_t NCH>
+static void encode_frame_residuals(bufio &bio, codec_state *codec,
+	uint32_t nch, uint32_t flen, const int32_t *res, uint32_t stride) {
+	uint32_t fpos, ch;
+
+	if (NCH) nch = NCH;
+	for (fpos = 0; fpos < flen; fpos++, res += stride)
+		for (ch = 0; ch < nch; ch++)
+			bio.put_value(codec[ch], res[ch]);
+} // encode_frame_residuals
+
+// The per-sample loops of a frame, specialized for mono, stereo or any
+// channel count and for the sample depth. The set is selected once by
+// frame_alloc, the passes get the channel count anyway for the general
+// case.
+class codec_pass {
+public:
+	// entropy decoding
+	uint32_t (*decode)(bufio &bio, codec_state *codec, uint32_t nch,
+		uint32_t flen, int32_t *res, uint32_t stride, uint32_t limit);
+	// entropy encoding
+	void (*encode)(bufio &bio, codec_state *codec, uint32_t nch,
+		uint32_t flen, const int32_t *res, uint32_t stride);
+	// inter-channel decorrelation of the decoded frame and PCM output
+	void (*write)(const int32_t *res, uint32_t stride, uint32_t nch,
+		uint32_t count, uint8_t *output);
+	// PCM input and inter-channel correlation of the frame to encode
+	void (*read)(const uint8_t *input, uint32_t nch, uint32_t count,
+		int32_t *res, uint32_t stride);
+	// decorrelation and output of 32-bit values [int32, float][planar]
+	void (*write32[2][2])(const int32_t *res, uint32_t stride, uint32_t nch,
+		uint32_t count, uint8_t **output, float scale);
+	// input of 32-bit values and correlation [int32, float][planar]
+	void (*read32[2][2])(const uint8_t **input, uint32_t nch, uint32_t count,
+		int32_t *res, uint32_t stride, float scale);
+}; // class codec_pass
+
+#define CODEC_PASS(n, d) { \
+	decode_frame_residuals<n>, encode_frame_residuals<n>, \
+	pcm_write<n, d>, pcm_read<n, d>, \
+	{ { pcm_write32<n, int32_t, false>, pcm_write32<n, int32_t, true> }, \
+	{ pcm_write32<n, float, false>, pcm_write32<n, float, true> } }, \
+	{ { pcm_read32<n, int32_t, false>, pcm_read32<n, int32_t, true> }, \
+	{ pcm_read32<n, float, false>, pcm_read32<n, float, true> } } }
+
+// [channels: any, mono, stereo][depth: 2, 3]
+static const codec_pass codec_passes[3][2] = {
+	{ CODEC_PASS(0, 2), CODEC_PASS(0, 3) },
+	{ CODEC_PASS(1, 2), CODEC_PASS(1, 3) },
+	{ CODEC_PASS(2, 2), CODEC_PASS(2, 3) }
+};
 
-	if (m_bufio.read_crc32()) return false;
+// allocate memory for the frame data, more than two channels
+// are filtered in lanes; selects the frame passes
+void codec_base::frame_alloc(uint32_t nch) {
+	uint32_t size;
+
+	m_stride = (nch > 2) ? TTA_LANES : nch;
+	size = flen_std * m_stride;
+	if (size > m_frame_size) {
+		mem_free(m_frame);
+		m_frame = nullptr;
+		m_frame_size = 0;
+		m_frame = (int32_t *) mem_alloc(size * sizeof(int32_t));
+		m_frame_size = size;
+	}
+	tta_memclear(m_frame, size * sizeof(int32_t));
+	if (m_stride == TTA_LANES && !m_lanes)
+		m_lanes = ::new (mem_alloc(sizeof(codec_lanes))) codec_lanes;
+	m_pass = &codec_passes[(nch <= 2) ? nch : 0][depth - 2];
+} // frame_alloc
+
+// runs the worker on the calling thread and threads-1 helpers
+static void run_workers(uint32_t threads, const std::function<void()>& worker) {
+	std::vector<std::thread> pool;
+	std::exception_ptr err;
+	std::mutex lock;
+
+	auto guarded = [&]() {
+		try {
+			worker();
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (!err) err = std::current_exception();
+		}
+	};
 
-	return true;
+	for (uint32_t i = 1; i < threads; i++)
+		pool.emplace_back(guarded);
+	guarded();
+
+	for (auto& t : pool) t.join();
+	if (err) std::rethrow_exception(err);
+} // run_workers
+
+
+//////////////////////////// decoder functions //////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// the seek table positions from the frame sizes, in place: the sizes are
+// stored in the second half of the table and every entry is loaded before
+// the entries over it are stored
+static void seek_table_sum(uint64_t *table, const uint8_t *sizes,
+	uint32_t count, uint64_t pos) {
+	uint32_t i = 0;
+
+#if defined(PCM_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i base = _mm_set1_epi64x((int64_t) pos);
+
+	// 4 entries at a time: the prefix sums of the pairs,
+	// then the sum of the first pair added to the second
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(sizes + i * 4));
+		__m128i a = _mm_unpacklo_epi32(v, zero);
+		__m128i b = _mm_unpackhi_epi32(v, zero);
+		a = _mm_add_epi64(a, _mm_slli_si128(a, 8));
+		b = _mm_add_epi64(b, _mm_slli_si128(b, 8));
+		b = _mm_add_epi64(b, _mm_unpackhi_epi64(a, a));
+		_mm_storeu_si128((__m128i *)(table + i),
+			_mm_add_epi64(base, _mm_slli_si128(a, 8)));
+		_mm_storeu_si128((__m128i *)(table + i + 2),
+			_mm_add_epi64(base, _mm_unpackhi_epi64(a, _mm_slli_si128(b, 8))));
+		base = _mm_add_epi64(base, _mm_unpackhi_epi64(b, b));
+	}
+	_mm_storel_epi64((__m128i *) &pos, base);
+#endif
+
+	for (; i < count; i++) {
+		uint32_t size = read_le32(sizes + i * 4);
+		table[i] = pos;
+		pos += size;
+	}
+	table[count] = pos; // end of the last frame
+} // seek_table_sum
+
+// reads the seek table as a block, it is checked by check_seek_table
+void decoder::read_seek_table() {
+	uint32_t size = (frames + 1) * 4;
+
+	seek_pending = false;
+	if (!seek_table) return;
+
+	m_bufio.read_bytes((uint8_t *) seek_table + size, size);
+	seek_pending = true;
 } // read_seek_table
 
+// checks the crc of the seek table read and sums up the positions,
+// returns if the seek is allowed
+bool decoder::check_seek_table() {
+	uint32_t size = frames * 4;
+	uint8_t *sizes = (uint8_t *) seek_table + size + 4;
+
+	if (!seek_pending) return seek_allowed;
+	seek_pending = false;
+
+	if (read_le32(sizes + size) !=
+		(crc32_span(0xffffffffUL, sizes, size) ^ 0xffffffffUL))
+		return (seek_allowed = false);
+
+	seek_table_sum(seek_table, sizes, frames, offset + size + 4);
+	return (seek_allowed = true);
+} // check_seek_table
+
 void decoder::frame_init(uint32_t frame, bool seek_needed) {
 	int32_t shift = flt_set[depth - 1];
 	codec_state *dec = m_codec;
@@ -685,6 +1336,7 @@ void decoder::frame_init(uint32_t frame, bool seek_needed) {
 		if (pos && m_bufio.io()->Seek(pos) < 0)
 			throw exception(error::SEEK_FILE);
 		m_bufio.reader_start();
+		fstart = pos;
 	}
 
 	if (fnum == frames - 1)
@@ -696,6 +1348,7 @@ void decoder::frame_init(uint32_t frame, bool seek_needed) {
 	} while (++dec <= m_codec_last);
 
 	fpos = 0;
+	frame_ready = false;
 
 	m_bufio.reset();
 } // frame_init
@@ -710,12 +1363,365 @@ void decoder::set_position(uint32_t seconds, uint32_t *new_pos) {
 	uint32_t frame = DIV_FRAME_TIME(seconds);
 	*new_pos = MUL_FRAME_TIME(frame);
 
-	if (!seek_allowed || frame >= frames)
+	if (!check_seek_table() || frame >= frames)
 		throw exception(error::SEEK_FILE);
 
 	frame_init(frame, true);
 } // set_position
 
+// seeks to the frame of the sample, the output starts at the sample when
+// the frame is decoded: the samples before it are not packed
+uint64_t decoder::seek_to_sample(uint64_t sample) {
+	uint32_t frame;
+
+	if (!check_seek_table() || !frames ||
+		sample >= (uint64_t)(frames - 1) * flen_std + flen_last)
+		throw exception(error::SEEK_FILE);
+
+	frame = (uint32_t)(sample / flen_std);
+	frame_init(frame, true);
+	fpos = (uint32_t)(sample - (uint64_t) frame * flen_std);
+
+	return sample;
+} // seek_to_sample
+
+// entropy pass of 'frame' from 'pos' up to about 'limit' bytes, returns
+// if its crc matches; 'size' is the size of the frame with its crc, 0 if
+// it can't be read
+bool decoder::frame_scan(uint32_t frame, uint64_t pos, uint32_t limit,
+	uint32_t *size) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	bool crc;
+
+	*size = 0;
+	if (m_bufio.io()->Seek(pos) < 0) return false;
+	m_bufio.reader_start();
+
+	try {
+		frame_init(frame, false);
+		if (m_pass->decode(m_bufio, m_codec, nch, flen,
+			m_frame, m_stride, limit) < flen) return false;
+		crc = m_bufio.read_crc32();
+	} catch (exception &) {
+		return false;
+	}
+
+	*size = m_bufio.count();
+	return !crc;
+} // frame_scan
+
+// checks the frame of 'size' bytes at 'pos' by its crc alone, without
+// the entropy pass; the sizes beyond the largest frame possible fail
+bool decoder::frame_check(uint64_t pos, uint32_t size) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+
+	if (size <= 4 || size > (uint64_t) flen_std * nch * (depth + 1) + 64)
+		return false;
+	if (m_bufio.io()->Seek(pos) < 0) return false;
+	m_bufio.reader_start();
+	m_bufio.reset();
+
+	try {
+		m_bufio.reader_skip_bytes(size - 4);
+		return !m_bufio.read_crc32();
+	} catch (exception &) {
+		return false;
+	}
+} // frame_check
+
+// finds the start of a frame of 'size' bytes nearest to 'guess' within
+// 'range' bytes and after 'pos' by its crc alone: one pass over the bytes
+// gives the running crc register, and the crc of each candidate follows
+// from the registers at its start and end; 0 if there is none
+uint64_t decoder::frame_locate(uint64_t pos, uint64_t guess, uint32_t range,
+	uint32_t size) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint64_t lo = (guess > pos + range) ? guess - range : pos + 1, at = 0;
+	uint32_t count, len, n, d, crc, reg = 0xffffffffUL;
+	uint32_t *head, *tail;
+	const uint8_t *data;
+	uint8_t *buffer = nullptr;
+	uint64_t avail = 0;
+	int32_t res;
+
+	if (size <= 4 || size > (uint64_t) flen_std * nch * (depth + 1) + 64 ||
+		guess + range < lo)
+		return 0;
+	count = (uint32_t)(guess + range - lo) + 1; // candidates
+	len = count + size - 1; // bytes of all of them
+
+	if (m_bufio.io()->Seek(lo) < 0) return 0;
+	data = m_bufio.io()->Data(&avail);
+	if (!data) {
+		buffer = (uint8_t *) tta_malloc(len);
+		if (buffer == NULL)
+			throw exception(error::MEMORY_INSUFFICIENT);
+		for (avail = 0; avail < len; avail += res) {
+			res = m_bufio.io()->Read(buffer + avail, (uint32_t)(len - avail));
+			if (res <= 0) break;
+		}
+		data = buffer;
+	}
+	if (avail < len) len = (uint32_t) avail;
+	if (len < size) {
+		if (buffer) tta_free(buffer);
+		return 0;
+	}
+	count = len - size + 1;
+
+	// the registers at the start and at the end of the crc span of each
+	// candidate, the crc itself is in the last 4 bytes of the frame
+	head = (uint32_t *) tta_malloc(count * 2 * sizeof(uint32_t));
+	if (head == NULL) {
+		if (buffer) tta_free(buffer);
+		throw exception(error::MEMORY_INSUFFICIENT);
+	}
+	tail = head + count;
+	for (n = 0; n < count + size - 4; n++) {
+		if (n < count) head[n] = reg;
+		if (n >= size - 4) tail[n - (size - 4)] = reg;
+		reg = crc32_slice8(reg, data + n, 1);
+	}
+
+	crc32_shift shift(size - 4);
+	for (d = 0; !at && d <= range; d++) {
+		for (uint32_t k = 0; !at && k < (d ? 2U : 1U); k++) {
+			uint64_t cand = k ? guess - d : guess + d;
+			if (k ? guess < lo + d : guess + d - lo >= count) continue;
+			n = (uint32_t)(cand - lo);
+			crc = tail[n] ^ shift.zeros(head[n] ^ 0xffffffffUL) ^ 0xffffffffUL;
+			if (crc == read_le32(data + n + size - 4)) at = cand;
+		}
+	}
+
+	tta_free(head);
+	if (buffer) tta_free(buffer);
+	return at;
+} // frame_locate
+
+// finds the start of 'frame' nearest to 'guess' within 'range' bytes and
+// after 'pos' by the entropy pass, while the 'scans' last; 0 if there is
+// none
+uint64_t decoder::frame_resync(uint32_t frame, uint64_t pos, uint64_t guess,
+	uint32_t range, uint32_t limit, uint32_t *scans) {
+	uint64_t at;
+	uint32_t d, n, size;
+
+	for (d = 0; d <= range; d++) {
+		for (n = 0; n < (d ? 2U : 1U); n++) {
+			if (n ? guess <= pos + d : guess + d <= pos) continue;
+			at = n ? guess - d : guess + d;
+
+			if (!*scans) return 0;
+			(*scans)--;
+			if (frame_scan(frame, at, limit, &size)) return at;
+		}
+	}
+
+	return 0;
+} // frame_resync
+
+// finds the frame boundaries when the seek table is lost. The entries
+// of the broken table are tried first: a frame of the stored size that
+// passes its crc is taken without the entropy pass. Otherwise the frame
+// is passed through the entropy decoder over its known length and checked
+// with its crc.
+// After a frame with a crc mismatch, one of the next TTA_RESYNC_FRAMES
+// frames is searched where it passes its crc: at its stored position, then
+// around the end of the entropy pass and around the average frame size
+// away, in a range growing with the distance. All the candidates of a
+// range are checked by the crc of the stored frame size in one pass over
+// it, and only then by the entropy pass, TTA_RESYNC_SCANS times at most.
+// The frames skipped get their stored positions if these led to the
+// match, or share the space between evenly.
+// Without a match the frame ends where its entropy pass ends; if the next
+// frame is not found either, the scan stops there. The count of
+// the frames with a crc mismatch is returned in 'bad'. The decoder goes
+// back to the start of its frame and decodes it again up to its position.
+bool decoder::rebuild_seek_table(uint32_t *bad) {
+	uint32_t frame = fnum, pos = fpos;
+	uint64_t tmp = offset + (frames + 1) * 4, end, next, avg, at;
+	uint32_t i, j, k, size, limit, range, scans, hint, errors = 0;
+	uint8_t *stored;
+	bool ok = false, exact, lost = false;
+
+	if (bad) *bad = 0;
+	if (!seek_table) return false;
+	if (check_seek_table()) return true;
+
+	// the sizes of the broken table, the positions overwrite them
+	stored = (uint8_t *) tta_malloc(frames * 4 + 4);
+	if (stored == NULL)
+		throw exception(error::MEMORY_INSUFFICIENT);
+	memcpy(stored, (uint8_t *) seek_table + (frames + 1) * 4, frames * 4);
+
+	seek_table[0] = tmp;
+
+	for (i = 0; i < frames;) {
+		seek_table[i] = tmp;
+		size = read_le32(stored + i * 4);
+		if (frame_check(tmp, size) || frame_scan(i, tmp, UINT32_MAX, &size)) {
+			tmp += size;
+			i++;
+			lost = false;
+			continue;
+		}
+
+		// the runaway passes over a corrupted start stop at twice the
+		// average size
+		avg = i ? (tmp - seek_table[0]) / i : 0;
+		limit = (avg && avg < UINT32_MAX / 2) ? (uint32_t)(avg * 2) : UINT32_MAX;
+		// the sizes of the frames differ by some tenths of a percent
+		range = (avg >> 8 > TTA_RESYNC_RANGE) ? (uint32_t)(avg >> 8) : TTA_RESYNC_RANGE;
+		end = tmp + size;
+		next = 0;
+
+		// the stored sizes of the corrupted frame and the ones after it
+		for (j = i + 1, at = tmp; !next && j < frames && j <= i + TTA_RESYNC_FRAMES; j++) {
+			at += read_le32(stored + (j - 1) * 4);
+			if (frame_check(at, read_le32(stored + j * 4))) next = at;
+		}
+		exact = (next != 0);
+
+		// the search by the crc of the stored size, which must be about
+		// the average one
+		if (!next) {
+			for (j = i + 1; !next && j < frames && j <= i + TTA_RESYNC_FRAMES; j++) {
+				hint = read_le32(stored + j * 4);
+				if (hint < avg / 2 || hint > limit) continue;
+				if (size)
+					next = frame_locate(tmp, end, TTA_RESYNC_RANGE * (j - i), hint);
+				if (!next && avg)
+					next = frame_locate(tmp, tmp + avg * (j - i), range * (j - i), hint);
+			}
+		}
+
+		// then by the entropy pass
+		if (!next) {
+			scans = TTA_RESYNC_SCANS;
+			for (j = i + 1; !next && j < frames && j <= i + TTA_RESYNC_FRAMES; j++) {
+				if (j == i + 1 && size)
+					next = frame_resync(j, tmp, end, TTA_RESYNC_RANGE, limit, &scans);
+				if (!next && avg)
+					next = frame_resync(j, tmp, tmp + avg * (j - i),
+						range * (j - i), limit, &scans);
+			}
+		}
+
+		if (next) {
+			// the frames from i to j - 1 are corrupted, j starts at 'next';
+			// the stored sizes that led there give their starts too
+			for (j--, k = i + 1; k < j; k++) {
+				if (exact) seek_table[k] = seek_table[k - 1] + read_le32(stored + (k - 1) * 4);
+				else seek_table[k] = tmp + (next - tmp) * (k - i) / (j - i);
+			}
+			errors += j - i;
+			tmp = next;
+			i = j;
+			lost = false;
+			continue;
+		}
+
+		// a second frame in a row not found, the position is lost
+		errors++;
+		if (!size || lost) break; // or past the end of the file
+		tmp = end;
+		i++;
+		lost = true;
+	}
+	seek_table[i] = tmp;
+	ok = (i == frames);
+	tta_free(stored);
+
+	// back to the start of the decoder frame, which is known whether the
+	// table is rebuilt up to it or not
+	if (m_bufio.io()->Seek(fstart) < 0)
+		throw exception(error::SEEK_FILE);
+	m_bufio.reader_start();
+	frame_init(frame, false);
+	fpos = pos;
+
+	if (bad) *bad = errors;
+	seek_allowed = ok;
+	return ok;
+} // rebuild_seek_table
+
+// loads the seek table from a sidecar index written by write_seek_index,
+// in place if the index fileio has the data in memory
+bool decoder::read_seek_index(fileio *io) {
+	uint32_t size = TTA_INDEX_HEADER_SIZE + (frames + 1) * 8;
+	uint64_t length = 0;
+	const uint8_t *data;
+	uint8_t *buffer = nullptr;
+	uint32_t i;
+	bool ok = false;
+
+	if (!seek_table) return false;
+	if (check_seek_table()) return true;
+
+	data = io->Data(&length);
+	if (!data || length < size + 4) {
+		buffer = (uint8_t *) tta_malloc(size + 4);
+		if (buffer == NULL)
+			throw exception(error::MEMORY_INSUFFICIENT);
+		if (io->Read(buffer, size + 4) != (int32_t)(size + 4)) {
+			tta_free(buffer);
+			return false;
+		}
+		data = buffer;
+	}
+
+	if (read_le32(data) == TTA_INDEX_MAGIC &&
+		read_le32(data + 4) == TTA_INDEX_VERSION &&
+		read_le32(data + 8) == frames &&
+		read_le32(data + 12) == flen_std &&
+		read_le64(data + 16) == offset &&
+		read_le32(data + size) ==
+			(crc32_span(0xffffffffUL, data, size) ^ 0xffffffffUL) &&
+		read_le64(data + TTA_INDEX_HEADER_SIZE) == offset + (frames + 1) * 4) {
+		ok = true;
+		for (i = 0; i <= frames && ok; i++) {
+			seek_table[i] = read_le64(data + TTA_INDEX_HEADER_SIZE + i * 8);
+			if (i && seek_table[i] <= seek_table[i - 1]) ok = false;
+		}
+	}
+
+	if (buffer) tta_free(buffer);
+
+	if (ok) seek_allowed = true;
+	return ok;
+} // read_seek_index
+
+// writes the seek table as a sidecar index, which 'read_seek_index' of
+// the later opens loads instead of rebuilding the table
+void decoder::write_seek_index(fileio *io) {
+	uint32_t size = TTA_INDEX_HEADER_SIZE + (frames + 1) * 8;
+	uint8_t *buffer;
+	uint32_t i, crc;
+	int32_t res;
+
+	if (!check_seek_table())
+		throw exception(error::SEEK_FILE);
+
+	buffer = (uint8_t *) tta_malloc(size + 8);
+	if (buffer == NULL)
+		throw exception(error::MEMORY_INSUFFICIENT);
+
+	write_le64(buffer, TTA_INDEX_MAGIC | ((uint64_t) TTA_INDEX_VERSION << 32));
+	write_le64(buffer + 8, frames | ((uint64_t) flen_std << 32));
+	write_le64(buffer + 16, offset);
+	for (i = 0; i <= frames; i++)
+		write_le64(buffer + TTA_INDEX_HEADER_SIZE + i * 8, seek_table[i]);
+	crc = crc32_span(0xffffffffUL, buffer, size) ^ 0xffffffffUL;
+	write_le64(buffer + size, crc);
+
+	res = io->Write(buffer, size + 4);
+	tta_free(buffer);
+
+	if (res != (int32_t)(size + 4))
+		throw exception(error::WRITE_FILE);
+} // write_seek_index
+
 void decoder::init(info *i, uint64_t pos, const std::string& password) {
 	// set start position if required
 	if (pos && m_bufio.io()->Seek(pos) < 0)
@@ -732,6 +1738,7 @@ void decoder::init(info *i, uint64_t pos, const std::string& password) {
 		throw exception(error::FORMAT_INCOMPATIBLE);
 
 	// check for required data is present
+	m_data = 0;
 	if (i->format == FORMAT_ENCRYPTED) {
 		if (password == "")
 			throw exception(error::PASSWORD_PROTECTED);
@@ -747,84 +1754,125 @@ void decoder::init(info *i, uint64_t pos, const std::string& password) {
 	if (!flen_last) flen_last = flen_std;
 	rate = 0;
 
-	// allocate memory for seek table data
-	seek_table = (uint64_t *) tta_malloc(frames * sizeof(uint64_t));
-	if (seek_table == NULL)
-		throw exception(error::MEMORY_INSUFFICIENT);
+	// allocate memory for seek table data (+1 for the end of data)
+	table_alloc(frames + 1);
+
+	seek_allowed = false;
+	read_seek_table();
+	if (!seek_lazy) check_seek_table();
+	fstart = offset + (frames + 1) * 4;
 
-	seek_allowed = read_seek_table();
-	m_codec = new codec_state[i->nch];
-	m_codec_last = m_codec + i->nch - 1;
+	codec_alloc(i->nch);
+	frame_alloc(i->nch);
 
 	frame_init(0, false);
 } // init
 
+uint32_t decoder::frame_decode(uint32_t limit, impl_type it) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint32_t count;
+
+	// entropy pass
+	count = m_pass->decode(m_bufio, m_codec, nch, flen,
+		m_frame, m_stride, limit);
+
+	// check frame crc
+	frame_crc = m_bufio.read_crc32();
+	frame_ready = true;
+
+	if (frame_crc) {
+		tta_memclear(m_frame, flen * m_stride * sizeof(int32_t));
+		return count;
+	}
+
+	frame_filter(count, it);
+	return count;
+} // frame_decode
+
+// filter pass of the first 'count' samples of the frame, the channels
+// run side by side in lanes or one column after another
+void decoder::frame_filter(uint32_t count, impl_type it) {
+	const TTA_kernels *ks = filter_kernels(it);
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint32_t ch, n;
+
+	if (m_stride == TTA_LANES) {
+		for (n = 0; n < TTA_LANES; n++)
+			hybrid_filter_lanes_init(m_lanes, n, m_data, flt_set[depth - 1]);
+		ks->lanes_dec(m_lanes, m_frame, count, nch);
+	} else {
+		for (ch = 0; ch < nch; ch++)
+			m_codec[ch].decode(ks, m_frame + ch, count, m_stride);
+	}
+} // frame_filter
+
+// bytes of one sample of all the channels in the input or output format
+uint32_t codec_base::sample_size() const {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	return nch * ((m_format == sample_format::pcm) ? depth : 4);
+} // sample_size
+
+// decorrelation and output of 'count' samples of the frame data in the
+// output format, interleaved at out[0] or planar; advances the pointers
+void decoder::frame_write(const int32_t *res, uint32_t stride,
+	uint32_t count, uint8_t **out, bool planar) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+
+	if (m_format == sample_format::pcm && !planar) {
+		m_pass->write(res, stride, nch, count, out[0]);
+		out[0] += count * nch * depth;
+	} else {
+		m_pass->write32[m_format == sample_format::float32][planar](res,
+			stride, nch, count, out, 1.0f / (float)(1U << (depth * 8 - 1)));
+	}
+} // frame_write
+
+void decoder::set_output_format(sample_format format) { m_format = format; }
+
 int decoder::process_stream(uint8_t *output, uint32_t out_bytes,
 	CALLBACK callback, impl_type it) {
-	codec_state *dec = m_codec;
-	uint8_t *ptr = output;
-	int32_t cache[MAX_NCH];
-	int32_t *cp = cache;
-	int32_t *end, *smp;
-	int32_t value;
-	int32_t ret = 0;
+	return stream_decode(&output, out_bytes / sample_size(), false,
+		callback, it);
+} // process_stream
 
-	while (fpos < flen
-		&& ptr < output + out_bytes) {
-		value = m_bufio.get_value(*dec);
+// writes int32 or float32 values (the pcm format writes int32) into the
+// plane of each channel, 'count' samples at most
+int decoder::process_stream_planar(void *const *output, uint32_t count,
+	CALLBACK callback, impl_type it) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint8_t *out[MAX_NCH];
+	uint32_t ch;
 
-		switch (it) {
-		case impl_type::native:
-			dec->decode<impl_type::native>(&value);
-			break;
-		case impl_type::compat:
-			dec->decode<impl_type::compat>(&value);
-			break;
-		default:
-			throw exception(error::UNSUPPORTED_ARCH);
-		}
+	for (ch = 0; ch < nch; ch++)
+		out[ch] = (uint8_t *) output[ch];
 
-		if (dec < m_codec_last) {
-			*cp++ = value;
-			dec++;
-		} else {
-			*cp = value;
-
-			if (m_codec_last == m_codec) {
-				WRITE_BUFFER(cp, ptr, depth);
-			} else {
-				end = cp;
-				smp = cp - 1;
-
-				*cp += *smp / 2;
-				while (smp > cache) {
-					*smp = *cp-- - *smp;
-					smp--;
-				}
-				*smp = *cp - *smp;
+	return stream_decode(out, count, true, callback, it);
+} // process_stream_planar
 
-				while (smp <= end) {
-					WRITE_BUFFER(smp, ptr, depth);
-					smp++;
-				}
-			}
+int decoder::stream_decode(uint8_t **out, uint32_t samples, bool planar,
+	CALLBACK callback, impl_type it) {
+	uint32_t count;
+	int32_t ret = 0;
 
-			cp = cache;
-			fpos++;
-			ret++;
-			dec = m_codec;
-		}
+	while (fpos < flen) {
+		count = samples - ret;
+		if (!count) break;
 
-		if (fpos == flen) {
-			// check frame crc
-			bool crc_flag = m_bufio.read_crc32();
+		if (!frame_ready)
+			frame_decode(UINT32_MAX, it);
 
-			if (crc_flag) {
-				tta_memclear(output, out_bytes);
-				if (!seek_allowed) break;
-			}
+		// decorrelation and output pass
+		if (count > flen - fpos) count = flen - fpos;
+		frame_write(m_frame + fpos * m_stride, m_stride, count, out, planar);
+		fpos += count;
+		ret += count;
+
+		if (fpos == flen) {
+			// the next frame can't be found without the seek table
+			if (frame_crc && !check_seek_table()) break;
 
 			fnum++;
+			fstart += m_bufio.count();
 
 			// update dynamic info
 			rate = (m_bufio.count() << 3) / 1070;
@@ -832,90 +1880,252 @@ int decoder::process_stream(uint8_t *output, uint32_t out_bytes,
 				callback(rate, fnum, frames);
 			if (fnum == frames) break;
 
-			frame_init(fnum, crc_flag);
+			frame_init(fnum, frame_crc);
 		}
 	}
 
 	return ret;
-} // process_stream
+} // stream_decode
 
 int decoder::process_frame(uint32_t in_bytes, uint8_t *output,
 	uint32_t out_bytes,
 	impl_type it) {
-	codec_state *dec = m_codec;
-	uint8_t *ptr = output;
-	int32_t cache[MAX_NCH];
-	int32_t *cp = cache;
-	int32_t *end, *smp;
-	int32_t value;
-	int32_t ret = 0;
+	uint32_t count = out_bytes / sample_size();
 
-	while (m_bufio.count() < in_bytes
-		&& ptr < output + out_bytes) {
-		value = m_bufio.get_value(*dec);
+	if (!frame_ready) {
+		// the frame may be shorter than expected, its crc follows the data
+		flen = frame_decode(in_bytes - 4, it);
 
-		switch (it) {
-		case impl_type::native:
-			dec->decode<impl_type::native>(&value);
-			break;
-		case impl_type::compat:
-			dec->decode<impl_type::compat>(&value);
-			break;
-		default:
-			throw exception(error::UNSUPPORTED_ARCH);
-		}
+		// update dynamic info
+		rate = (m_bufio.count() << 3) / 1070;
+	}
 
-		if (dec < m_codec_last) {
-			*cp++ = value;
-			dec++;
-		} else {
-			*cp = value;
+	if (count > flen - fpos) count = flen - fpos;
+	frame_write(m_frame + fpos * m_stride, m_stride, count, &output, false);
+	fpos += count;
 
-			if (m_codec_last == m_codec) {
-				WRITE_BUFFER(cp, ptr, depth);
-			} else {
-				end = cp;
-				smp = cp - 1;
+	return count;
+} // process_frame
 
-				*cp += *smp / 2;
+int decoder::process_stream_mt(uint8_t *output, uint32_t out_bytes,
+	uint32_t threads, CALLBACK callback, impl_type it) {
+	const TTA_kernels *ks = filter_kernels(it);
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint32_t smp_size = sample_size();
+	uint32_t first, count, len, size, i;
+	int32_t res, ret = 0;
+
+	if (threads < 2 || !check_seek_table())
+		return process_stream(output, out_bytes, callback, it);
+
+	// finish the current frame in place
+	if (fpos) {
+		len = (flen - fpos) * smp_size;
+		ret = process_stream(output, (len < out_bytes) ? len : out_bytes, callback, it);
+		if (fpos || fnum == frames) return ret;
+		output += ret * smp_size;
+		out_bytes -= ret * smp_size;
+	}
 
-				while (smp > cache) {
-					*smp = *cp-- - *smp;
-					smp--;
-				}
-				*smp = *cp - *smp;
+	// count the whole frames that fit into the output buffer
+	first = fnum;
+	for (count = 0, len = 0; first + count < frames; count++) {
+		uint32_t flen_cur = (first + count == frames - 1) ? flen_last : flen_std;
+		if (len + flen_cur * smp_size > out_bytes) break;
+		len += flen_cur * smp_size;
+	}
 
-				while (smp <= end) {
-					WRITE_BUFFER(smp, ptr, depth);
-					smp++;
+	if (!count || m_bufio.io()->Seek(seek_table[first]) < 0)
+		return ret + process_stream(output, out_bytes, callback, it);
+
+	// load compressed data of the frames at once, unless it is in memory
+	size = (uint32_t)(seek_table[first + count] - seek_table[first]);
+	std::vector<uint8_t> buffer;
+	uint64_t avail;
+	const uint8_t *data = m_bufio.io()->Data(&avail);
+	if (!data || avail < size) {
+		buffer.resize(size);
+		for (len = 0; len < size; len += res) {
+			res = m_bufio.io()->Read(buffer.data() + len, size - len);
+			if (res <= 0) throw exception(error::READ_FILE);
+		}
+		data = buffer.data();
+	}
+
+	// a worker decodes a group of frames, the filter runs all the channels
+	// of the group in lanes side by side
+	uint32_t group = TTA_LANES / nch;
+	uint32_t groups = (count + group - 1) / group;
+	std::atomic<uint32_t> next(0);
+	int32_t shift = flt_set[depth - 1];
+
+	run_workers((threads < groups) ? threads : groups, [&]() {
+		std::unique_ptr<codec_state[]> codec(new codec_state[nch]);
+		std::unique_ptr<TTA_fltst_lanes<TTA_LANES>> fs(new TTA_fltst_lanes<TTA_LANES>);
+		std::vector<int32_t> res((size_t) flen_std * TTA_LANES);
+		bool crc_ok[TTA_LANES];
+		memio mio;
+		bufio bio(&mio);
+		uint32_t k, g, n, gfirst, gcount, frame;
+
+		while ((k = next++) < groups) {
+			gfirst = k * group;
+			gcount = (count - gfirst < group) ? count - gfirst : group;
+
+			for (n = 0; n < TTA_LANES; n++)
+				hybrid_filter_lanes_init(fs.get(), n, m_data, shift);
+
+			for (g = 0; g < gcount; g++) {
+				frame = first + gfirst + g;
+
+				mio.assign(data + (seek_table[frame] - seek_table[first]),
+					seek_table[frame + 1] - seek_table[frame]);
+				bio.reader_start();
+				bio.reset();
+
+				for (n = 0; n < nch; n++)
+					codec[n].init(m_data, shift, 10, 10); // init entropy decoder
+
+				// running past the frame data means the frame is corrupted
+				try {
+					m_pass->decode(bio, codec.get(), nch,
+						(frame == frames - 1) ? flen_last : flen_std,
+						res.data() + g * nch, TTA_LANES, UINT32_MAX);
+					crc_ok[g] = !bio.read_crc32();
+				} catch (exception& ex) {
+					if (ex.error() != error::READ_FILE) throw;
+					crc_ok[g] = false;
 				}
 			}
 
-			cp = cache;
-			fpos++;
-			ret++;
-			dec = m_codec;
+			frame = first + gfirst;
+			ks->lanes_dec(fs.get(), res.data(),
+				(frame == frames - 1) ? flen_last : flen_std, TTA_LANES);
+
+			for (g = 0; g < gcount; g++, frame++) {
+				uint32_t frame_len = (frame == frames - 1) ? flen_last : flen_std;
+				uint8_t *ptr = output + (size_t)(gfirst + g) * flen_std * smp_size;
+
+				// check frame crc
+				if (crc_ok[g])
+					frame_write(res.data() + g * nch, TTA_LANES, frame_len, &ptr, false);
+				else tta_memclear(ptr, frame_len * smp_size);
+			}
 		}
+	});
 
-		if (fpos == flen ||
-			m_bufio.count() == in_bytes - 4) {
-			// check frame crc
-			if (m_bufio.read_crc32())
-				tta_memclear(output, out_bytes);
+	for (i = 0; i < count; i++, fnum++) {
+		ret += (fnum == frames - 1) ? flen_last : flen_std;
 
-			// update dynamic info
-			rate = (m_bufio.count() << 3) / 1070;
+		// update dynamic info
+		rate = (uint32_t)(((seek_table[fnum + 1] - seek_table[fnum]) << 3) / 1070);
+		if (callback)
+			callback(rate, fnum + 1, frames);
+	}
 
-			break;
+	if (fnum < frames) {
+		frame_init(fnum, true);
+	} else fpos = flen;
+
+	return ret;
+} // process_stream_mt
+
+int decoder::process_stream(std::span<uint8_t> output, CALLBACK callback,
+	impl_type it) {
+	size_t size = (output.size() < UINT32_MAX) ? output.size() : UINT32_MAX;
+	return process_stream(output.data(), (uint32_t) size, callback, it);
+} // process_stream
+
+// decodes the frame from its data in memory, the crc included
+int decoder::process_frame(uint32_t frame, std::span<const uint8_t> input,
+	std::span<uint8_t> output, impl_type it) {
+	size_t size = (output.size() < UINT32_MAX) ? output.size() : UINT32_MAX;
+
+	if (input.size() < 4 || input.size() > UINT32_MAX)
+		throw exception(error::READ_FILE);
+
+	m_span.assign(input.data(), input.size());
+	frame_reset(frame, &m_span);
+
+	return process_frame((uint32_t) input.size(), output.data(),
+		(uint32_t) size, it);
+} // process_frame
+
+int decoder::process_stream_mt(std::span<uint8_t> output, uint32_t threads,
+	CALLBACK callback, impl_type it) {
+	size_t size = (output.size() < UINT32_MAX) ? output.size() : UINT32_MAX;
+	return process_stream_mt(output.data(), (uint32_t) size, threads, callback, it);
+} // process_stream_mt
+
+// decodes 'count' samples from the 'first' one: the seek table gives the
+// frames of the range, the whole frames are decoded on 'threads' threads
+// and the last frame is decoded whole for its crc, but written up to the
+// end of the range only; the decoder stays at the end of the range
+int decoder::decode_range(uint64_t first, uint32_t count, uint8_t *output,
+	uint32_t threads, impl_type it) {
+	uint32_t smp_size = sample_size();
+	uint64_t end = (uint64_t)(frames - 1) * flen_std + flen_last;
+	uint32_t tail = 0, len, part;
+	int32_t res, ret = 0;
+
+	seek_to_sample(first);
+	if (count > end - first) count = (uint32_t)(end - first);
+	if (count > INT32_MAX) count = INT32_MAX; // the count returned
+	if (!count) return 0;
+
+	// the samples of a part of the last frame
+	if (first + count < end)
+		tail = (uint32_t)((first + count) % flen_std);
+	end = first + count;
+
+	// the first frame from the sample and the whole frames
+	if (first / flen_std < end / flen_std || !tail) {
+		len = count - tail;
+		while ((uint32_t) ret < len) {
+			// the output size of a call is counted in 32 bits
+			part = len - ret;
+			if (part > UINT32_MAX / smp_size) part = UINT32_MAX / smp_size;
+			res = process_stream_mt(output + (size_t) ret * smp_size,
+				part * smp_size, threads, nullptr, it);
+			if (res <= 0) throw exception(error::READ_FILE);
+			ret += res;
 		}
 	}
 
+	if (tail) {
+		// the crc follows the whole frame, a frame with a crc mismatch
+		// is written as silence like in process_stream; the rest of the
+		// frame stays decoded for the next call
+		frame_decode(UINT32_MAX, it);
+		output += (size_t) ret * smp_size;
+		frame_write(m_frame + fpos * m_stride, m_stride, tail - fpos,
+			&output, false);
+		ret += tail - fpos;
+		fpos = tail;
+	}
+
 	return ret;
-} // process_frame
+} // decode_range
 
 uint32_t decoder::get_rate() { return rate; }
 
-decoder::decoder(fileio *io) : codec_base(io), seek_allowed(false) {} // decoder
+decoder::decoder(fileio *io) : codec_base(io), seek_allowed(false), seek_pending(false), seek_lazy(false),
+	frame_ready(false), frame_crc(false), fstart(0) {} // decoder
+
+// the seek table of the next init is read as is and checked at the
+// first seek, so the first frame is decoded without waiting for it
+void decoder::set_lazy_seek(bool lazy) { seek_lazy = lazy; }
+
+// reads the stream straight from the caller's memory
+decoder::decoder(std::span<const uint8_t> input) : decoder(&m_span) {
+	m_span.assign(input.data(), input.size());
+} // decoder
+
+// the next stream is read straight from the caller's memory
+void decoder::reopen(std::span<const uint8_t> input) {
+	m_span.assign(input.data(), input.size());
+	reopen(&m_span);
+} // reopen
 
 decoder::~decoder() {} // ~decoder
 
@@ -943,9 +2153,82 @@ void encoder::write_seek_table() {
 	m_bufio.writer_done();
 } // write_seek_table
 
+// the headers of a stream of unknown length: an id3v2 tag padded with
+// the unused seek table space, then the TTA header and the seek table
+void encoder::write_stream_headers() {
+	uint64_t samples;
+	uint32_t size, pad;
+
+	frames = fnum;
+	samples = frames ? (uint64_t)(frames - 1) * flen_std + flen_last : 0;
+	if (samples > UINT32_MAX)
+		throw exception(error::FORMAT_INCOMPATIBLE);
+	m_info.samples = (uint32_t) samples;
+
+	// the table outgrew the reserved space, the frame data would have
+	// to move
+	if (frames > m_reserved)
+		throw exception(error::WRITE_FILE);
+
+	pad = (m_reserved - frames) * 4;
+	size = TTA_STREAM_TAG_SIZE - 10 + pad;
+
+	if (m_bufio.io()->Seek(m_start) < 0)
+		throw exception(error::SEEK_FILE);
+
+	m_bufio.writer_start();
+	m_bufio.reset();
+
+	// id3v2.3 header, the size is 7 bits per byte
+	m_bufio.write_byte('I');
+	m_bufio.write_byte('D');
+	m_bufio.write_byte('3');
+	m_bufio.write_uint16(3);
+	m_bufio.write_byte(0);
+	m_bufio.write_byte((size >> 21) & 0x7f);
+	m_bufio.write_byte((size >> 14) & 0x7f);
+	m_bufio.write_byte((size >> 7) & 0x7f);
+	m_bufio.write_byte(size & 0x7f);
+
+	// TSSE frame, big endian size
+	m_bufio.write_byte('T');
+	m_bufio.write_byte('S');
+	m_bufio.write_byte('S');
+	m_bufio.write_byte('E');
+	m_bufio.write_uint32(7 << 24);
+	m_bufio.write_uint16(0);
+	m_bufio.write_byte(0); // ISO-8859-1
+	for (const char *c = "libtta"; *c; c++)
+		m_bufio.write_byte(*c);
+
+	m_bufio.writer_skip_bytes(pad);
+	m_bufio.write_tta_header(&m_info);
+	m_bufio.writer_done();
+
+	offset = m_start + TTA_STREAM_TAG_SIZE + pad + 22;
+	write_seek_table();
+} // write_stream_headers
+
+// the size of the frame just finished, the table of a stream of unknown
+// length grows as needed
+void encoder::seek_table_add(uint64_t size) {
+	uint64_t *table;
+
+	if (fnum == m_capacity) {
+		table = (uint64_t *) mem_alloc((size_t) m_capacity * 2 * sizeof(uint64_t));
+		tta_memcpy(table, seek_table, m_capacity * sizeof(uint64_t));
+		mem_free(seek_table);
+		seek_table = table;
+		m_capacity *= 2;
+	}
+
+	seek_table[fnum++] = size;
+} // seek_table_add
+
 void encoder::frame_init(uint32_t frame) {
 	int32_t shift = flt_set[depth - 1];
 	codec_state *enc = m_codec;
+	uint32_t n;
 
 	if (frame >= frames) return;
 
@@ -959,6 +2242,10 @@ void encoder::frame_init(uint32_t frame) {
 		enc->init(m_data, shift, 10, 10); // init entropy encoder
 	} while (++enc <= m_codec_last);
 
+	if (m_lanes)
+		for (n = 0; n < TTA_LANES; n++)
+			hybrid_filter_lanes_init(m_lanes, n, m_data, shift);
+
 	fpos = 0;
 
 	m_bufio.reset();
@@ -982,6 +2269,7 @@ void encoder::init(info *i, uint64_t pos, const std::string& password) {
 	if (pos && m_bufio.io()->Seek(pos) < 0)
 		throw exception(error::SEEK_FILE);
 
+	m_data = 0;
 	if (password == "") {
 		i->format = FORMAT_SIMPLE;
 	} else {
@@ -989,139 +2277,376 @@ void encoder::init(info *i, uint64_t pos, const std::string& password) {
 		compute_key_digits(password.c_str(),  password.size(), &m_data); // set password
 	}
 
-	m_bufio.writer_start();
-	pos += m_bufio.write_tta_header(i);
-
-	offset = pos; // size of headers
 	format = i->format;
 	depth = (i->bps + 7) / 8;
 	flen_std = MUL_FRAME_TIME(i->sps);
-	flen_last = i->samples % flen_std;
-	frames = i->samples / flen_std + (flen_last ? 1 : 0);
-	if (!flen_last) flen_last = flen_std;
 	rate = 0;
 
-	// allocate memory for seek table data
-	seek_table = (uint64_t *) tta_malloc(frames * sizeof(uint64_t));
-	if (seek_table == NULL)
-		throw exception(error::MEMORY_INSUFFICIENT);
+	// the samples count of 0 is unknown, the headers are written by
+	// finalize in the space reserved here
+	m_stream = (i->samples == 0);
+	m_start = pos;
+	m_info = *i;
 
-	m_bufio.writer_skip_bytes((frames + 1) * 4);
-	m_codec = new codec_state[i->nch];
-	m_codec_last = m_codec + i->nch - 1;
-	shift_bits = (4 - depth) << 3;
+	m_bufio.writer_start();
+	if (m_stream) {
+		frames = UINT32_MAX;
+		flen_last = flen_std;
+		m_reserved = m_bound ? m_bound / flen_std + (m_bound % flen_std ? 1 : 0) :
+			TTA_STREAM_FRAMES;
+		m_bufio.writer_skip_bytes(TTA_STREAM_TAG_SIZE + 22 + (m_reserved + 1) * 4);
+	} else {
+		pos += m_bufio.write_tta_header(i);
+		offset = pos; // size of headers
+		flen_last = i->samples % flen_std;
+		frames = i->samples / flen_std + (flen_last ? 1 : 0);
+		if (!flen_last) flen_last = flen_std;
+		m_bufio.writer_skip_bytes((frames + 1) * 4);
+	}
+
+	// allocate memory for seek table data
+	table_alloc(m_stream ? m_reserved : frames);
+	codec_alloc(i->nch);
+	frame_alloc(i->nch);
 
 	frame_init(0);
 } // init_set_info
 
 void encoder::finalize() {
+	if (!m_stream) {
+		m_bufio.writer_done();
+		write_seek_table();
+		return;
+	}
+
+	// the last frame ends with the input
+	if (fpos) {
+		m_bufio.flush_bit_cache();
+		flen_last = fpos;
+		seek_table_add(m_bufio.count());
+	}
+
 	m_bufio.writer_done();
-	write_seek_table();
+	write_stream_headers();
 } // finalize
 
-void encoder::process_stream(uint8_t *input, uint32_t in_bytes,
-	CALLBACK callback, impl_type it) {
-	codec_state *enc = m_codec;
-	uint8_t *ptr = input;
-	uint8_t *pend = input + in_bytes;
-	int32_t curr, next, temp;
-	int32_t res = 0;
+// input of 'count' samples in the input format, interleaved from in[0]
+// or planar, and correlation into the frame data; advances the pointers
+void encoder::frame_read(const uint8_t **in, uint32_t count, int32_t *res,
+	uint32_t stride, bool planar) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+
+	if (m_format == sample_format::pcm && !planar) {
+		m_pass->read(in[0], nch, count, res, stride);
+		in[0] += count * nch * depth;
+	} else {
+		m_pass->read32[m_format == sample_format::float32][planar](in, nch,
+			count, res, stride, (float)(1U << (depth * 8 - 1)));
+	}
+} // frame_read
 
-	if (!in_bytes) return;
+void encoder::frame_encode(const uint8_t **in, uint32_t count, bool planar,
+	impl_type it) {
+	const TTA_kernels *ks = filter_kernels(it);
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint32_t ch;
 
-	READ_BUFFER(temp, ptr, depth, shift_bits);
-	next = temp >> shift_bits;
+	// correlation pass
+	frame_read(in, count, m_frame, m_stride, planar);
 
-	do {
-		curr = next;
-		if (ptr <= pend) {
-			READ_BUFFER(temp, ptr, depth, shift_bits);
-			next = temp >> shift_bits;
-		}
+	// filter pass, the channels run side by side in lanes
+	// or one column after another
+	if (m_stride == TTA_LANES) {
+		ks->lanes_enc(m_lanes, m_frame, count, nch);
+	} else {
+		for (ch = 0; ch < nch; ch++)
+			m_codec[ch].encode(ks, m_frame + ch, count, m_stride);
+	}
 
-		// transform data
-		if (m_codec_last != m_codec) {
-			if (enc < m_codec_last) {
-				curr = res = next - curr;
-			} else curr -= res / 2;
-		}
+	// entropy pass
+	m_pass->encode(m_bufio, m_codec, nch, count, m_frame, m_stride);
+	fpos += count;
+} // frame_encode
 
-		enc->encode<impl_type::native>(&curr);
+void encoder::set_input_format(sample_format format) { m_format = format; }
 
-		m_bufio.put_value(*enc, curr);
+void encoder::set_stream_length(uint32_t samples) { m_bound = samples; }
 
-		if (enc < m_codec_last) {
-			enc++;
-		} else {
-			enc = m_codec;
-			fpos++;
-		}
+void encoder::process_stream(uint8_t *input, uint32_t in_bytes,
+	CALLBACK callback, impl_type it) {
+	const uint8_t *in = input;
+	stream_encode(&in, in_bytes / sample_size(), false, callback, it);
+} // process_stream
+
+// reads int32 or float32 values (the pcm format reads int32) from the
+// plane of each channel, 'count' samples
+void encoder::process_stream_planar(const void *const *input, uint32_t count,
+	CALLBACK callback, impl_type it) {
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	const uint8_t *in[MAX_NCH];
+	uint32_t ch;
+
+	for (ch = 0; ch < nch; ch++)
+		in[ch] = (const uint8_t *) input[ch];
+
+	stream_encode(in, count, true, callback, it);
+} // process_stream_planar
+
+void encoder::stream_encode(const uint8_t **in, uint32_t count, bool planar,
+	CALLBACK callback, impl_type it) {
+	uint32_t len;
+
+	while (count && fpos < flen) {
+		len = flen - fpos;
+		if (len > count) len = count;
+		frame_encode(in, len, planar, it);
+		count -= len;
 
 		if (fpos == flen) {
 			m_bufio.flush_bit_cache();
-			seek_table[fnum++] = m_bufio.count();
+			seek_table_add(m_bufio.count());
 
 			// update dynamic info
 			rate = (m_bufio.count() << 3) / 1070;
 			if (callback)
-				callback(rate, fnum, frames);
+				callback(rate, fnum, m_stream ? 0 : frames);
 
 			frame_init(fnum);
 		}
-	} while (ptr <= pend);
-} // process_stream
+	}
+} // stream_encode
 
 void encoder::process_frame(uint8_t *input, uint32_t in_bytes, impl_type it) {
-	codec_state *enc = m_codec;
-	uint8_t *ptr = input;
-	uint8_t *pend = input + in_bytes;
-	int32_t curr, next, temp;
-	int32_t res = 0;
+	const uint8_t *in = input;
+	uint32_t count = in_bytes / sample_size();
 
-	if (!in_bytes) return;
+	if (count > flen - fpos) count = flen - fpos;
+	if (!count) return;
 
-	READ_BUFFER(temp, ptr, depth, shift_bits);
-	next = temp >> shift_bits;
+	frame_encode(&in, count, false, it);
 
-	do {
-		curr = next;
-		if (ptr <= pend) {
-			READ_BUFFER(temp, ptr, depth, shift_bits);
-			next = temp >> shift_bits;
-		}
+	if (fpos == flen) {
+		m_bufio.flush_bit_cache();
 
-		// transform data
-		if (m_codec_last != m_codec) {
-			if (enc < m_codec_last) {
-				curr = res = next - curr;
-			} else curr -= res / 2;
-		}
+		// update dynamic info
+		rate = (m_bufio.count() << 3) / 1070;
+	}
+} // process_frame
+
+void encoder::process_stream_mt(uint8_t *input, uint32_t in_bytes,
+	uint32_t threads, uint32_t window, CALLBACK callback, impl_type it) {
+	const TTA_kernels *ks = filter_kernels(it);
+	uint32_t nch = (uint32_t)(m_codec_last - m_codec) + 1;
+	uint32_t smp_size = sample_size();
+	uint32_t first, count, len, k;
+
+	if (threads < 2) {
+		process_stream(input, in_bytes, callback, it);
+		return;
+	}
 
-		enc->encode<impl_type::native>(&curr);
+	// a worker encodes a group of frames at once
+	uint32_t group = TTA_LANES / nch;
+	if (window < threads * group) window = threads * group;
+
+	// finish the current frame in place
+	if (fpos) {
+		len = (flen - fpos) * smp_size;
+		if (len > in_bytes) len = in_bytes;
+		process_stream(input, len, callback, it);
+		input += len;
+		in_bytes -= len;
+	}
 
-		m_bufio.put_value(*enc, curr);
+	// count the whole frames in the input buffer
+	first = fnum;
+	for (count = 0, len = 0; first + count < frames; count++) {
+		uint32_t flen_cur = (first + count == frames - 1) ? flen_last : flen_std;
+		if (len + flen_cur * smp_size > in_bytes) break;
+		len += flen_cur * smp_size;
+	}
 
-		if (enc < m_codec_last) {
-			enc++;
-		} else {
-			enc = m_codec;
-			fpos++;
+	if (count) {
+		std::vector<std::vector<uint8_t>> slot(window);
+		std::vector<uint8_t> ready(window);
+		std::vector<std::thread> pool;
+		std::condition_variable cv;
+		std::exception_ptr err;
+		std::mutex lock;
+		uint32_t next = 0, written = 0;
+		int32_t shift = flt_set[depth - 1];
+
+		auto fail = [&]() {
+			std::lock_guard<std::mutex> guard(lock);
+			if (!err) err = std::current_exception();
+			cv.notify_all();
+		};
+
+		// workers encode groups of frames into the slots of the in-flight
+		// window, the filter runs all the channels of the group in lanes
+		auto worker = [&]() {
+			std::unique_ptr<codec_state[]> codec(new codec_state[nch]);
+			std::unique_ptr<TTA_fltst_lanes<TTA_LANES>> fs(new TTA_fltst_lanes<TTA_LANES>);
+			std::vector<int32_t> res((size_t) flen_std * TTA_LANES);
+			memio mio;
+			bufio bio(&mio);
+			uint32_t gfirst, gcount, frame, g, n;
+
+			try {
+				std::unique_lock<std::mutex> guard(lock);
+				while (1) {
+					cv.wait(guard, [&]() {
+						return err || next >= count ||
+							next + ((count - next < group) ? count - next : group) <= written + window; });
+					if (err || next >= count) break;
+					gfirst = next;
+					gcount = (count - next < group) ? count - next : group;
+					next += gcount;
+					guard.unlock();
+
+					for (n = 0; n < TTA_LANES; n++)
+						hybrid_filter_lanes_init(fs.get(), n, m_data, shift);
+
+					for (g = 0, frame = first + gfirst; g < gcount; g++, frame++) {
+						const uint8_t *in = input + (size_t)(gfirst + g) * flen_std * smp_size;
+						frame_read(&in, (frame == frames - 1) ? flen_last : flen_std,
+							res.data() + g * nch, TTA_LANES, false);
+					}
+
+					frame = first + gfirst;
+					ks->lanes_enc(fs.get(), res.data(),
+						(frame == frames - 1) ? flen_last : flen_std, TTA_LANES);
+
+					for (g = 0; g < gcount; g++, frame++) {
+						std::vector<uint8_t> &out = slot[(gfirst + g) % window];
+						out.clear();
+						mio.assign(&out);
+						bio.writer_start();
+						bio.reset();
+
+						for (n = 0; n < nch; n++)
+							codec[n].init(m_data, shift, 10, 10); // init entropy encoder
+
+						m_pass->encode(bio, codec.get(), nch,
+							(frame == frames - 1) ? flen_last : flen_std,
+							res.data() + g * nch, TTA_LANES);
+						bio.flush_bit_cache();
+						bio.writer_done();
+					}
+
+					guard.lock();
+					for (g = 0; g < gcount; g++)
+						ready[(gfirst + g) % window] = 1;
+					cv.notify_all();
+				}
+			} catch (...) {
+				fail();
+			}
+		};
+
+		// flush the headers or previous frames ahead of the stitched data
+		m_bufio.writer_done();
+
+		for (k = 0; k < threads && k < count; k++)
+			pool.emplace_back(worker);
+
+		// write out the frames in order
+		try {
+			for (k = 0; k < count; k++) {
+				std::unique_lock<std::mutex> guard(lock);
+				cv.wait(guard, [&]() { return err || ready[k % window]; });
+				if (err) break;
+				guard.unlock();
+
+				std::vector<uint8_t> &out = slot[k % window];
+				if (m_bufio.io()->Write(out.data(), (uint32_t) out.size()) != (int32_t) out.size())
+					throw exception(error::WRITE_FILE);
+				seek_table_add(out.size());
+
+				// update dynamic info
+				rate = (uint32_t)((out.size() << 3) / 1070);
+				if (callback)
+					callback(rate, fnum, m_stream ? 0 : frames);
+
+				guard.lock();
+				ready[k % window] = 0;
+				written++;
+				cv.notify_all();
+			}
+		} catch (...) {
+			fail();
 		}
 
-		if (fpos == flen) {
-			m_bufio.flush_bit_cache();
+		for (auto& t : pool) t.join();
+		if (err) std::rethrow_exception(err);
 
-			// update dynamic info
-			rate = (m_bufio.count() << 3) / 1070;
+		frame_init(fnum);
+	}
 
-			break;
-		}
-	} while (ptr <= pend);
+	if (len < in_bytes)
+		process_stream(input + len, in_bytes - len, callback, it);
+} // process_stream_mt
+
+// the input is passed in parts of whole samples, each part fits uint32_t
+void encoder::process_stream(std::span<const uint8_t> input,
+	CALLBACK callback, impl_type it) {
+	size_t part = (UINT32_MAX / sample_size()) * sample_size();
+	size_t pos, size;
+
+	for (pos = 0; pos < input.size(); pos += size) {
+		size = (input.size() - pos < part) ? input.size() - pos : part;
+		process_stream(const_cast<uint8_t *>(input.data()) + pos,
+			(uint32_t) size, callback, it);
+	}
+} // process_stream
+
+// encodes the samples of the input as one whole frame into the output,
+// returns the size of the frame with its crc
+uint32_t encoder::process_frame(uint32_t frame, std::span<const uint8_t> input,
+	std::span<uint8_t> output, impl_type it) {
+	size_t size = (input.size() < UINT32_MAX) ? input.size() : UINT32_MAX;
+
+	m_span.assign_output(output.data(), output.size());
+	frame_reset(frame, &m_span);
+
+	process_frame(const_cast<uint8_t *>(input.data()), (uint32_t) size, it);
+	if (fpos != flen) m_bufio.flush_bit_cache(); // short frame
+	m_bufio.writer_done();
+
+	return (uint32_t) m_span.length();
 } // process_frame
 
+void encoder::process_stream_mt(std::span<const uint8_t> input,
+	uint32_t threads, uint32_t window, CALLBACK callback, impl_type it) {
+	size_t part = (UINT32_MAX / sample_size()) * sample_size();
+	size_t pos, size;
+
+	for (pos = 0; pos < input.size(); pos += size) {
+		size = (input.size() - pos < part) ? input.size() - pos : part;
+		process_stream_mt(const_cast<uint8_t *>(input.data()) + pos,
+			(uint32_t) size, threads, window, callback, it);
+	}
+} // process_stream_mt
+
+// the count of bytes written to the output span
+uint64_t encoder::get_output_size() const { return m_span.length(); }
+
 uint32_t encoder::get_rate() { return rate; }
 
-encoder::encoder(fileio *io) : codec_base(io) {} // encoder
+encoder::encoder(fileio *io) : codec_base(io), m_start(0), m_reserved(0),
+	m_bound(0), m_stream(false) {} // encoder
+
+// writes the stream into the caller's memory, throws WRITE_FILE
+// if it doesn't fit
+encoder::encoder(std::span<uint8_t> output) : encoder(&m_span) {
+	m_span.assign_output(output.data(), output.size());
+} // encoder
+
+// the next stream is written into the caller's memory
+void encoder::reopen(std::span<uint8_t> output) {
+	m_span.assign_output(output.data(), output.size());
+	reopen(&m_span);
+} // reopen
 
 encoder::~encoder() {} // ~encoder
 
@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h> 
+#include <string.h>
 #include <stdexcept>
 
 #ifdef CARIBBEAN
@@ -33,6 +34,7 @@
 
 #include <functional>
 #include <new>
+#include <span>
 #include <string>
 
 #define MAX_DEPTH 3
@@ -40,6 +42,7 @@
 #define MIN_BPS 16
 #define MAX_NCH 6
 #define TTA_FIFO_BUFFER_SIZE 5120
+#define FDIO_BUFFER_SIZE (1 << 20)
 
 #ifdef __GNUC__
 #define TTA_EXTERN_API __attribute__((visibility("default")))
@@ -83,10 +86,11 @@ typedef RMuint64 (uint64_t);
 // typedef uint64_t (uint64_t);
 #define tta_memclear(__dest,__length) memset(__dest,0,__length)
 #define tta_memcpy(__dest,__source,__length) memcpy(__dest,__source,__length)
+// the size of aligned_alloc is a multiple of the alignment
 #if defined(__APPLE__)
-#define tta_malloc(__length) _aligned_alloc(16,__length)
+#define tta_malloc(__length) _aligned_alloc(16,((__length)+15)&~(size_t)15)
 #else
-#define tta_malloc(__length) aligned_alloc(16,__length)
+#define tta_malloc(__length) aligned_alloc(16,((__length)+15)&~(size_t)15)
 #endif
 #define tta_free free
 #endif
@@ -132,7 +136,8 @@ namespace tta
 		IX86_AVX,
 		IX86_AVX512,
 		ARM,
-		AARCH64
+		AARCH64,
+		PORTABLE_SIMD
 	};
 
 	enum class impl_type {
@@ -148,13 +153,29 @@ namespace tta
 		uint32_t samples; // data length in samples
 	};
 
+	// output format of the decoder or input format of the encoder: PCM
+	// of the stream depth, 32-bit integers or 32-bit floats in [-1, 1)
+	enum class sample_format { pcm, int32, float32 };
+
 	// progress callback
 	typedef std::function<void(uint32_t, uint32_t, uint32_t)> CALLBACK;
 
 	// architecture type compatibility
 	TTA_EXTERN_API cpu_arch binary_version();
+	TTA_EXTERN_API bool set_binary_version(cpu_arch arch);
 
 	class codec_state;
+	class codec_lanes;
+	class codec_pass;
+
+	// memory functions of a codec, for the seek table, the codec states
+	// and the frame data; 'alloc' returns 'size' bytes aligned to 'align'
+	// or nullptr, 'opaque' is passed to both functions as is
+	struct allocator {
+		void *(*alloc)(void *opaque, size_t size, size_t align);
+		void (*free)(void *opaque, void *ptr);
+		void *opaque;
+	};
 
 	class fileio
 	{
@@ -163,17 +184,88 @@ namespace tta
 		virtual int32_t Read(uint8_t *buffer, uint32_t size) = 0;
 		virtual int32_t Write(uint8_t *buffer, uint32_t size) = 0;
 		virtual int64_t Seek(int64_t offset) = 0;
+		// the rest of the stream from the current position, if it is all
+		// in memory; the decoder then reads it without copying
+		virtual const uint8_t *Data(uint64_t *) { return nullptr; }
 	};
 
+	class TTA_EXTERN_API spanio : public fileio
+	{
+	protected:
+		const uint8_t *m_data;
+		uint8_t *m_out;
+		uint64_t m_size;
+		uint64_t m_pos;
+		uint64_t m_length;
+	public:
+		spanio(const uint8_t *data = nullptr, uint64_t size = 0);
+
+		void assign(const uint8_t *data, uint64_t size);
+		void assign_output(uint8_t *data, uint64_t size);
+		uint64_t length() const;
+
+		int32_t Read(uint8_t *buffer, uint32_t size) override;
+		int32_t Write(uint8_t *buffer, uint32_t size) override;
+		int64_t Seek(int64_t offset) override;
+		const uint8_t *Data(uint64_t *size) override;
+	};
+
+#if defined(__GNUC__) && !defined(CARIBBEAN)
+	// fileio of a file descriptor, reads and writes it by 'buffer_size'
+	// bytes and keeps the kernel read-ahead going; the descriptor stays
+	// open. The flags:
+	//   FDIO_DIRECT   - transfer the whole blocks with O_DIRECT, bypassing
+	//                   the page cache, where the file system allows it
+	//   FDIO_DONTNEED - drop the pages already passed from the page cache
+	#define FDIO_DIRECT 1
+	#define FDIO_DONTNEED 2
+
+	class TTA_EXTERN_API fdio : public fileio
+	{
+	protected:
+		int m_fd;
+		uint32_t m_flags;
+		uint8_t *m_buffer;
+		uint32_t m_size;	// buffer size
+		uint32_t m_pos;	// position in the buffer
+		uint32_t m_len;	// count of bytes read into the buffer
+		uint64_t m_offset;	// file offset of the buffer
+		uint64_t m_dropped;	// the pages before it are dropped
+		int m_mode;
+		bool m_seekable;
+		bool m_direct;
+
+		void locate(uint64_t pos);
+		bool fill();
+		bool flush_buffer();
+		bool write_all(const uint8_t *buffer, uint32_t size, uint64_t offset);
+		void set_direct(bool on);
+		void drop(uint64_t offset, uint64_t size);
+	public:
+		fdio(int fd, uint32_t buffer_size = FDIO_BUFFER_SIZE, uint32_t flags = 0);
+		~fdio();
+
+		int32_t Read(uint8_t *buffer, uint32_t size) override;
+		int32_t Write(uint8_t *buffer, uint32_t size) override;
+		int64_t Seek(int64_t offset) override;
+		bool Flush();
+	};
+#endif // __GNUC__
+
 	class TTA_ALIGNED(16) bufio
 	{
 	private:
-		uint8_t m_buffer[TTA_FIFO_BUFFER_SIZE];
+		uint8_t m_fifo[TTA_FIFO_BUFFER_SIZE + 8]; // + padding for wide loads/stores
+		uint8_t *m_buffer; // m_fifo or a larger buffer
+		uint32_t m_size; // buffer size without the padding
 		uint8_t *m_pos;
+		uint8_t *m_end; // end of the data in buffer (reader)
+		uint8_t *m_crc_pos; // start of the data not in crc yet
 		uint32_t m_bcount; // count of bits in cache
-		uint32_t m_bcache; // bit cache
+		uint64_t m_bcache; // bit cache
 		uint32_t m_crc;
 		uint32_t m_count;
+		bool m_mapped; // reading straight from the fileio data
 		fileio *m_io;
 	public:
 		bufio(fileio *io);
@@ -181,6 +273,7 @@ namespace tta
 
 		void io(fileio* io);
 		fileio* io() const;
+		void buffer_size(uint32_t size);
 
 		__inline void reset();
 		__inline void reader_start();
@@ -188,6 +281,8 @@ namespace tta
 		__inline uint8_t read_byte();
 		__inline uint32_t read_uint16();
 		__inline uint32_t read_uint32();
+		void read_bytes(uint8_t *buffer, uint32_t size);
+		void reader_skip_bytes(uint32_t size);
 		__inline bool read_crc32();
 		__inline int32_t get_value(codec_state& c);
 		__inline uint32_t count() const;
@@ -203,8 +298,12 @@ namespace tta
 		__inline void flush_bit_cache();
 
 	private:
-		void reader_skip_bytes(uint32_t size);
+		void reader_fill();
 		uint32_t skip_id3v2();
+		__inline void update_crc();
+		__inline uint64_t peek_bits();
+		__inline void skip_bits(uint64_t bits, uint32_t count);
+		__inline void put_bits(uint64_t bits, uint32_t count);
 	};
 
 	class codec_base {
@@ -214,6 +313,10 @@ namespace tta
 
 		virtual void init(info *i, uint64_t pos, const std::string& password) = 0;
 		virtual uint32_t get_rate() = 0;
+		uint32_t get_frame_length() const;
+		void set_buffer_size(uint32_t size);
+		void set_allocator(const allocator *a);
+		void reopen(fileio *io);
 
 	protected:
 		codec_state* m_codec; // codec (1 per channel)
@@ -231,33 +334,84 @@ namespace tta
 		uint32_t flen;	// current frame length in samples
 		uint32_t fnum;	// currently playing frame index
 		uint32_t fpos;	// the current position in frame
+		codec_lanes *m_lanes; // filter states of the frame pass
+		int32_t *m_frame;	// frame data between the passes
+		uint32_t m_stride;	// frame data stride (samples)
+		const codec_pass *m_pass; // frame loops of the stream format
+		spanio m_span;	// io of the memory span functions
+		sample_format m_format;	// decoder output or encoder input format
+		allocator m_alloc;	// memory functions, the default ones if not set
+		uint32_t m_capacity;	// seek table entries allocated
+		uint32_t m_codec_count;	// codec states allocated
+		uint32_t m_frame_size;	// frame data allocated (values)
+
+		void *mem_alloc(size_t size);
+		void mem_free(void *ptr);
+		void table_alloc(uint32_t count);
+		void codec_alloc(uint32_t nch);
+		void frame_alloc(uint32_t nch);
+		void release();
+		uint32_t sample_size() const;
 	};
 
 	/////////////////////// TTA decoder functions /////////////////////////
 	class TTA_EXTERN_API decoder : public codec_base {
 	public:
 		explicit decoder(fileio *io);
+		explicit decoder(std::span<const uint8_t> input);
 		virtual ~decoder();
 
 		void init(info *i, uint64_t pos, const std::string& password) override;
 		void frame_reset(uint32_t frame, fileio *io);
 		int process_stream(uint8_t *output, uint32_t out_bytes, CALLBACK callback=nullptr, impl_type it=impl_type::native);
 		int process_frame(uint32_t in_bytes, uint8_t *output, uint32_t out_bytes, impl_type it=impl_type::native);
+		int process_stream_mt(uint8_t *output, uint32_t out_bytes, uint32_t threads, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		int process_stream(std::span<uint8_t> output, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		int process_frame(uint32_t frame, std::span<const uint8_t> input, std::span<uint8_t> output, impl_type it=impl_type::native);
+		int process_stream_mt(std::span<uint8_t> output, uint32_t threads, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		void reopen(std::span<const uint8_t> input);
+		using codec_base::reopen;
 		void set_position(uint32_t seconds, uint32_t *new_pos);
+		uint64_t seek_to_sample(uint64_t sample);
+		bool rebuild_seek_table(uint32_t *bad=nullptr);
+		bool read_seek_index(fileio *io);
+		void write_seek_index(fileio *io);
+		void set_lazy_seek(bool lazy);
+		void set_output_format(sample_format format);
+		int process_stream_planar(void *const *output, uint32_t count, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		int decode_range(uint64_t first, uint32_t count, uint8_t *output, uint32_t threads=1, impl_type it=impl_type::native);
 		uint32_t get_rate() override;
 		template<enum impl_type it>
 		int decode_stream(uint8_t *output, uint32_t out_bytes, CALLBACK callback=nullptr) {
 			return process_stream(output, out_bytes, callback, it);
 		}
 		template<enum impl_type it>
+		int decode_stream_mt(uint8_t *output, uint32_t out_bytes, uint32_t threads, CALLBACK callback=nullptr) {
+			return process_stream_mt(output, out_bytes, threads, callback, it);
+		}
+		template<enum impl_type it>
 		int decode_frame(uint32_t in_bytes, uint8_t *output, uint32_t out_bytes) {
 			return process_frame(in_bytes, output, out_bytes, it);
 		}
 
 	protected:
 		bool seek_allowed;	// seek table flag
-		bool read_seek_table();
+		bool seek_pending;	// the seek table is read but not checked
+		bool seek_lazy;	// the seek table is checked at the first seek
+		bool frame_ready;	// the current frame is decoded
+		bool frame_crc;	// the current frame crc mismatch
+		uint64_t fstart;	// file position of the current frame
+		void read_seek_table();
+		bool check_seek_table();
+		bool frame_scan(uint32_t frame, uint64_t pos, uint32_t limit, uint32_t *size);
+		bool frame_check(uint64_t pos, uint32_t size);
+		uint64_t frame_locate(uint64_t pos, uint64_t guess, uint32_t range, uint32_t size);
+		uint64_t frame_resync(uint32_t frame, uint64_t pos, uint64_t guess, uint32_t range, uint32_t limit, uint32_t *scans);
 		void frame_init(uint32_t frame, bool seek_needed);
+		uint32_t frame_decode(uint32_t limit, impl_type it);
+		void frame_filter(uint32_t count, impl_type it);
+		void frame_write(const int32_t *res, uint32_t stride, uint32_t count, uint8_t **out, bool planar);
+		int stream_decode(uint8_t **out, uint32_t samples, bool planar, CALLBACK callback, impl_type it);
 	}; // class decoder
 
 
@@ -265,37 +419,61 @@ namespace tta
 	class TTA_EXTERN_API encoder : public codec_base {
 	public:
 		explicit encoder(fileio *io);
+		explicit encoder(std::span<uint8_t> output);
 		virtual ~encoder();
 
 		void init(info *i, uint64_t pos, const std::string& password) override;
 		void frame_reset(uint32_t frame, fileio *io);
 		void process_stream(uint8_t *input, uint32_t in_bytes, CALLBACK callback=nullptr, impl_type it=impl_type::native);
 		void process_frame(uint8_t *input, uint32_t in_bytes, impl_type it=impl_type::native);
+		void process_stream_mt(uint8_t *input, uint32_t in_bytes, uint32_t threads, uint32_t window=0, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		void process_stream(std::span<const uint8_t> input, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		uint32_t process_frame(uint32_t frame, std::span<const uint8_t> input, std::span<uint8_t> output, impl_type it=impl_type::native);
+		void process_stream_mt(std::span<const uint8_t> input, uint32_t threads, uint32_t window=0, CALLBACK callback=nullptr, impl_type it=impl_type::native);
+		void reopen(std::span<uint8_t> output);
+		using codec_base::reopen;
+		void set_input_format(sample_format format);
+		void set_stream_length(uint32_t samples);
+		void process_stream_planar(const void *const *input, uint32_t count, CALLBACK callback=nullptr, impl_type it=impl_type::native);
 		void finalize();
+		uint64_t get_output_size() const;
 		uint32_t get_rate() override;
 		template<enum impl_type it>
 		void encode_stream(uint8_t *input, uint32_t in_bytes, CALLBACK callback=nullptr) {
 			process_stream(input, in_bytes, callback, it);
 		}
 		template<enum impl_type it>
+		void encode_stream_mt(uint8_t *input, uint32_t in_bytes, uint32_t threads, uint32_t window=0, CALLBACK callback=nullptr) {
+			process_stream_mt(input, in_bytes, threads, window, callback, it);
+		}
+		template<enum impl_type it>
 		void encode_frame(uint8_t *input, uint32_t in_bytes) {
 			process_frame(input, in_bytes, it);
 		}
 
 	protected:
-		uint32_t shift_bits; // packing int to pcm
+		info m_info;	// stream format, for the headers written by finalize
+		uint64_t m_start;	// stream start position
+		uint32_t m_reserved;	// seek table entries reserved in the headers
+		uint32_t m_bound;	// most samples of a stream of unknown length, 0 if unknown
+		bool m_stream;	// the count of samples is known at finalize only
 
 		void write_seek_table();
+		void write_stream_headers();
+		void seek_table_add(uint64_t size);
 		void frame_init(uint32_t frame);
+		void frame_read(const uint8_t **in, uint32_t count, int32_t *res, uint32_t stride, bool planar);
+		void frame_encode(const uint8_t **in, uint32_t count, bool planar, impl_type it);
+		void stream_encode(const uint8_t **in, uint32_t count, bool planar, CALLBACK callback, impl_type it);
 	}; // class encoder
 
 	//////////////////////// TTA exception class //////////////////////////
 	class exception : public std::exception {
-		error err;
+		tta::error err;
 
 	public:
-		explicit exception(error e) : err(e) {}
-		error error() const { return err; }
+		explicit exception(tta::error e) : err(e) {}
+		tta::error error() const { return err; }
 	}; // class exception
 } // namespace tta
 
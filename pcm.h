@@ -0,0 +1,414 @@
+/*
+ * pcm.h
+ *
+ * Description: TTA PCM packing and inter-channel decorrelation functions
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+#ifndef _PCM_H
+#define _PCM_H
+
+// The functions convert between interleaved little endian PCM of 'depth'
+// bytes per sample and the frame data, where channel c of sample t is
+// stored at res[t * stride + c]. The inter-channel decorrelation (decoder)
+// or correlation (encoder) is done in the same pass:
+//   decoder: x[last] += x[last - 1] / 2, x[c] = x[c + 1] - x[c] downwards
+//   encoder: x[c] = x[c + 1] - x[c] upwards, x[last] -= x[last - 1] / 2
+// NCH is the channel count known at compile time, 0 for any. Mono and
+// stereo frames stored without gaps (stride == nch) are converted 8 values
+// at a time with SSE2, the rest one sample at a time. The decoder output
+// and the encoder input can also be 32-bit integers or floats, interleaved
+// or planar (pcm_write32, pcm_read32).
+
+#include <cmath>
+#include <type_traits>
+
+#if defined(CPU_X86) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define PCM_SSE2
+#endif
+
+template<uint32_t depth>
+static __inline int32_t pcm_load(const uint8_t *p) {
+	if (depth == 2)
+		return (int16_t)(p[0] | (p[1] << 8));
+	return (int32_t)(((uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+		((uint32_t) p[2] << 16)) << 8) >> 8;
+} // pcm_load
+
+template<uint32_t depth>
+static __inline void pcm_store(uint8_t *p, int32_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t)(value >> 8);
+	if (depth == 3)
+		p[2] = (uint8_t)(value >> 16);
+} // pcm_store
+
+#if defined(PCM_SSE2)
+
+// x / 2 rounded toward zero, as in C
+static __inline __m128i pcm_half(__m128i x) {
+	return _mm_srai_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 31)), 1);
+} // pcm_half
+
+// the stereo pairs of x are (L, R) in the even and odd elements
+static __inline __m128i pcm_decorrelate2(__m128i x) {
+	const __m128i odd = _mm_setr_epi32(0, -1, 0, -1);
+	__m128i r = _mm_add_epi32(x, _mm_and_si128(odd,
+		_mm_slli_si128(pcm_half(x), 4)));
+	__m128i l = _mm_sub_epi32(_mm_srli_si128(r, 4), x);
+	return _mm_or_si128(_mm_and_si128(odd, r), _mm_andnot_si128(odd, l));
+} // pcm_decorrelate2
+
+static __inline __m128i pcm_correlate2(__m128i x) {
+	const __m128i odd = _mm_setr_epi32(0, -1, 0, -1);
+	__m128i l = _mm_sub_epi32(_mm_srli_si128(x, 4), x);
+	__m128i r = _mm_sub_epi32(x, _mm_slli_si128(pcm_half(l), 4));
+	return _mm_or_si128(_mm_and_si128(odd, r), _mm_andnot_si128(odd, l));
+} // pcm_correlate2
+
+// 8 values to 16 or 24 bytes
+template<uint32_t depth>
+static __inline void pcm_pack8(uint8_t *p, __m128i a, __m128i b) {
+	if (depth == 2) {
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i *) p, _mm_packs_epi32(a, b));
+	} else {
+		const __m128i lo24 = _mm_setr_epi32(0xffffff, 0, 0xffffff, 0);
+		const __m128i hi24 = _mm_setr_epi32(0, 0xffffff, 0, 0xffffff);
+		const __m128i lo48 = _mm_setr_epi32(-1, 0xffff, 0, 0);
+		const __m128i hi48 = _mm_setr_epi32(0, 0, -1, 0xffff);
+
+		// 2 values of 3 bytes in each 64-bit half, then 12 bytes in a row
+		a = _mm_or_si128(_mm_and_si128(a, lo24),
+			_mm_srli_epi64(_mm_and_si128(a, hi24), 8));
+		b = _mm_or_si128(_mm_and_si128(b, lo24),
+			_mm_srli_epi64(_mm_and_si128(b, hi24), 8));
+		a = _mm_or_si128(_mm_and_si128(a, lo48),
+			_mm_srli_si128(_mm_and_si128(a, hi48), 2));
+		b = _mm_or_si128(_mm_and_si128(b, lo48),
+			_mm_srli_si128(_mm_and_si128(b, hi48), 2));
+
+		_mm_storeu_si128((__m128i *) p, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storel_epi64((__m128i *)(p + 16), _mm_srli_si128(b, 4));
+	}
+} // pcm_pack8
+
+// 16 or 24 bytes to 8 values, reads 28 bytes for depth of 3
+template<uint32_t depth>
+static __inline void pcm_unpack8(const uint8_t *p, __m128i *a, __m128i *b) {
+	if (depth == 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		*a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		*b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+	} else {
+		const __m128i lo48 = _mm_setr_epi32(-1, 0xffff, 0, 0);
+		const __m128i hi48 = _mm_setr_epi32(0, 0, -1, 0xffff);
+		const __m128i even = _mm_setr_epi32(-1, 0, -1, 0);
+		__m128i v, u;
+
+		v = _mm_loadu_si128((const __m128i *) p);
+		v = _mm_or_si128(_mm_and_si128(v, lo48),
+			_mm_and_si128(_mm_slli_si128(v, 2), hi48));
+		u = _mm_srai_epi32(_mm_slli_epi64(v, 16), 8);
+		v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+		*a = _mm_or_si128(_mm_and_si128(even, v), _mm_andnot_si128(even, u));
+
+		v = _mm_loadu_si128((const __m128i *)(p + 12));
+		v = _mm_or_si128(_mm_and_si128(v, lo48),
+			_mm_and_si128(_mm_slli_si128(v, 2), hi48));
+		u = _mm_srai_epi32(_mm_slli_epi64(v, 16), 8);
+		v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+		*b = _mm_or_si128(_mm_and_si128(even, v), _mm_andnot_si128(even, u));
+	}
+} // pcm_unpack8
+
+#endif // PCM_SSE2
+
+/////////////////////////////// pcm_write ///////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// decorrelation of 'count' samples of the frame data and PCM output
+template<uint32_t NCH, uint32_t depth>
+static void pcm_write(const int32_t *res, uint32_t stride, uint32_t nch,
+	uint32_t count, uint8_t *out) {
+	int32_t value[MAX_NCH];
+	uint32_t i, n, ch;
+
+	if (NCH) nch = NCH;
+	if (nch <= 2 && stride == nch) {
+		n = count * nch;
+		i = 0;
+#if defined(PCM_SSE2)
+		for (; i + 8 <= n; i += 8, out += 8 * depth) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(res + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(res + i + 4));
+			if (nch == 2) {
+				a = pcm_decorrelate2(a);
+				b = pcm_decorrelate2(b);
+			}
+			pcm_pack8<depth>(out, a, b);
+		}
+#endif
+		if (nch == 1) {
+			for (; i < n; i++, out += depth)
+				pcm_store<depth>(out, res[i]);
+		} else {
+			for (; i < n; i += 2, out += 2 * depth) {
+				value[1] = res[i + 1] + res[i] / 2;
+				value[0] = value[1] - res[i];
+				pcm_store<depth>(out, value[0]);
+				pcm_store<depth>(out + depth, value[1]);
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++, res += stride) {
+		ch = nch - 1;
+		value[ch] = res[ch];
+		if (ch) value[ch] += res[ch - 1] / 2;
+		for (; ch > 0; ch--)
+			value[ch - 1] = value[ch] - res[ch - 1];
+
+		for (ch = 0; ch < nch; ch++, out += depth)
+			pcm_store<depth>(out, value[ch]);
+	}
+} // pcm_write
+
+////////////////////////////// pcm_write32 //////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// decorrelation of 'count' samples of the frame data and output of 32-bit
+// values T: int32_t, or float multiplied by 'scale'. The values are stored
+// interleaved at out[0], or the values of channel c at out[c] (planar);
+// the pointers are advanced past the values stored
+template<typename T>
+static __inline T pcm_value(int32_t value, float scale) {
+	if (std::is_floating_point<T>::value)
+		return (T)((float) value * scale);
+	return (T) value;
+} // pcm_value
+
+#if defined(PCM_SSE2)
+
+template<typename T>
+static __inline void pcm_store4(T *p, __m128i x, __m128 scale) {
+	if (std::is_floating_point<T>::value)
+		_mm_storeu_ps((float *) p, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+	else _mm_storeu_si128((__m128i *) p, x);
+} // pcm_store4
+
+#endif // PCM_SSE2
+
+template<uint32_t NCH, typename T, bool planar>
+static void pcm_write32(const int32_t *res, uint32_t stride, uint32_t nch,
+	uint32_t count, uint8_t **out, float scale) {
+	int32_t value[MAX_NCH];
+	T *p[MAX_NCH];
+	uint32_t i = 0, ch;
+
+	if (NCH) nch = NCH;
+	for (ch = 0; ch < (planar ? nch : 1); ch++)
+		p[ch] = (T *) out[ch];
+
+#if defined(PCM_SSE2)
+	// 4 samples at a time, the stereo pairs are split into the planes
+	if (nch <= 2 && stride == nch) {
+		__m128 mul = _mm_set1_ps(scale);
+		for (; i + 4 <= count; i += 4) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(res + i * nch));
+			if (nch == 1) {
+				pcm_store4<T>(p[0], a, mul);
+				p[0] += 4;
+				continue;
+			}
+			__m128i b = _mm_loadu_si128((const __m128i *)(res + i * nch + 4));
+			a = pcm_decorrelate2(a);
+			b = pcm_decorrelate2(b);
+			if (planar) {
+				a = _mm_shuffle_epi32(a, 0xd8);
+				b = _mm_shuffle_epi32(b, 0xd8);
+				pcm_store4<T>(p[0], _mm_unpacklo_epi64(a, b), mul);
+				pcm_store4<T>(p[1], _mm_unpackhi_epi64(a, b), mul);
+				p[0] += 4;
+				p[1] += 4;
+			} else {
+				pcm_store4<T>(p[0], a, mul);
+				pcm_store4<T>(p[0] + 4, b, mul);
+				p[0] += 8;
+			}
+		}
+		res += i * nch;
+	}
+#endif
+
+	for (; i < count; i++, res += stride) {
+		ch = nch - 1;
+		value[ch] = res[ch];
+		if (ch) value[ch] += res[ch - 1] / 2;
+		for (; ch > 0; ch--)
+			value[ch - 1] = value[ch] - res[ch - 1];
+
+		for (ch = 0; ch < nch; ch++)
+			*p[planar ? ch : 0]++ = pcm_value<T>(value[ch], scale);
+	}
+
+	for (ch = 0; ch < (planar ? nch : 1); ch++)
+		out[ch] = (uint8_t *) p[ch];
+} // pcm_write32
+
+//////////////////////////////// pcm_read ///////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// PCM input of 'count' samples and correlation into the frame data
+template<uint32_t NCH, uint32_t depth>
+static void pcm_read(const uint8_t *in, uint32_t nch, uint32_t count,
+	int32_t *res, uint32_t stride) {
+	int32_t value[MAX_NCH];
+	uint32_t i, n, ch;
+
+	if (NCH) nch = NCH;
+	if (nch <= 2 && stride == nch) {
+		n = count * nch;
+		i = 0;
+#if defined(PCM_SSE2)
+		// the 24-bit loads run 4 bytes past the 8 values
+		for (; i + 8 + (depth == 3 ? 2 : 0) <= n; i += 8, in += 8 * depth) {
+			__m128i a, b;
+			pcm_unpack8<depth>(in, &a, &b);
+			if (nch == 2) {
+				a = pcm_correlate2(a);
+				b = pcm_correlate2(b);
+			}
+			_mm_storeu_si128((__m128i *)(res + i), a);
+			_mm_storeu_si128((__m128i *)(res + i + 4), b);
+		}
+#endif
+		if (nch == 1) {
+			for (; i < n; i++, in += depth)
+				res[i] = pcm_load<depth>(in);
+		} else {
+			for (; i < n; i += 2, in += 2 * depth) {
+				value[0] = pcm_load<depth>(in);
+				value[1] = pcm_load<depth>(in + depth);
+				res[i] = value[1] - value[0];
+				res[i + 1] = value[1] - res[i] / 2;
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++, res += stride) {
+		for (ch = 0; ch < nch; ch++, in += depth)
+			value[ch] = pcm_load<depth>(in);
+
+		for (ch = 0; ch < nch - 1; ch++)
+			res[ch] = value[ch + 1] - value[ch];
+		res[ch] = value[ch];
+		if (ch) res[ch] -= res[ch - 1] / 2;
+	}
+} // pcm_read
+
+/////////////////////////////// pcm_read32 //////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// input of 'count' samples of 32-bit values T and correlation into the
+// frame data: int32_t clamped to [-scale, scale - 1], or float multiplied
+// by 'scale', clamped to the same range and rounded to the nearest
+// integer, so a value out of the depth can't break the stream. The values are
+// read interleaved from in[0], or the values of channel c from in[c]
+// (planar); the pointers are advanced past the values read
+template<typename T>
+static __inline int32_t pcm_sample(T value, float scale) {
+	if (std::is_floating_point<T>::value) {
+		float x = (float) value * scale;
+		if (!(x >= -scale)) x = -scale; // NaN too
+		if (x > scale - 1) x = scale - 1;
+		return (int32_t) lrintf(x);
+	}
+	int32_t lim = (int32_t) scale;
+	if ((int32_t) value < -lim) return -lim;
+	if ((int32_t) value > lim - 1) return lim - 1;
+	return (int32_t) value;
+} // pcm_sample
+
+#if defined(PCM_SSE2)
+
+template<typename T>
+static __inline __m128i pcm_load4(const T *p, __m128 scale) {
+	if (std::is_floating_point<T>::value) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps((const float *) p), scale);
+		x = _mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), scale));
+		x = _mm_min_ps(x, _mm_sub_ps(scale, _mm_set1_ps(1.0f)));
+		return _mm_cvtps_epi32(x);
+	}
+	// SSE2 has no min/max of int32, the compare masks select the limits
+	__m128i x = _mm_loadu_si128((const __m128i *) p);
+	__m128i hi = _mm_sub_epi32(_mm_cvtps_epi32(scale), _mm_set1_epi32(1));
+	__m128i lo = _mm_sub_epi32(_mm_setzero_si128(), _mm_cvtps_epi32(scale));
+	__m128i m = _mm_cmpgt_epi32(lo, x);
+	x = _mm_or_si128(_mm_and_si128(m, lo), _mm_andnot_si128(m, x));
+	m = _mm_cmpgt_epi32(x, hi);
+	return _mm_or_si128(_mm_and_si128(m, hi), _mm_andnot_si128(m, x));
+} // pcm_load4
+
+#endif // PCM_SSE2
+
+template<uint32_t NCH, typename T, bool planar>
+static void pcm_read32(const uint8_t **in, uint32_t nch, uint32_t count,
+	int32_t *res, uint32_t stride, float scale) {
+	int32_t value[MAX_NCH];
+	const T *p[MAX_NCH];
+	uint32_t i = 0, ch;
+
+	if (NCH) nch = NCH;
+	for (ch = 0; ch < (planar ? nch : 1); ch++)
+		p[ch] = (const T *) in[ch];
+
+#if defined(PCM_SSE2)
+	// 4 samples at a time, the planes are merged into the stereo pairs
+	if (nch <= 2 && stride == nch) {
+		__m128 mul = _mm_set1_ps(scale);
+		for (; i + 4 <= count; i += 4) {
+			__m128i a, b;
+			if (nch == 1) {
+				_mm_storeu_si128((__m128i *)(res + i), pcm_load4<T>(p[0], mul));
+				p[0] += 4;
+				continue;
+			}
+			if (planar) {
+				__m128i l = pcm_load4<T>(p[0], mul);
+				__m128i r = pcm_load4<T>(p[1], mul);
+				a = _mm_unpacklo_epi32(l, r);
+				b = _mm_unpackhi_epi32(l, r);
+				p[0] += 4;
+				p[1] += 4;
+			} else {
+				a = pcm_load4<T>(p[0], mul);
+				b = pcm_load4<T>(p[0] + 4, mul);
+				p[0] += 8;
+			}
+			_mm_storeu_si128((__m128i *)(res + i * 2), pcm_correlate2(a));
+			_mm_storeu_si128((__m128i *)(res + i * 2 + 4), pcm_correlate2(b));
+		}
+		res += i * nch;
+	}
+#endif
+
+	for (; i < count; i++, res += stride) {
+		for (ch = 0; ch < nch; ch++)
+			value[ch] = pcm_sample<T>(*p[planar ? ch : 0]++, scale);
+
+		for (ch = 0; ch < nch - 1; ch++)
+			res[ch] = value[ch + 1] - value[ch];
+		res[ch] = value[ch];
+		if (ch) res[ch] -= res[ch - 1] / 2;
+	}
+
+	for (ch = 0; ch < (planar ? nch : 1); ch++)
+		in[ch] = (const uint8_t *) p[ch];
+} // pcm_read32
+
+#endif // _PCM_H
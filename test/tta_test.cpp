@@ -0,0 +1,429 @@
+/*
+ * tta_test.cpp
+ *
+ * Description: TTA library tests
+ * Copyright (c) 1999-2015 Aleksander Djuric. All rights reserved.
+ * Distributed under the GNU Lesser General Public License (LGPL).
+ * The complete text of the license can be found in the COPYING
+ * file included in the distribution.
+ *
+ */
+
+// Each test is run by its name, 'tta_test <name>', and returns 0 if it
+// passes. The tests go through the public interface of the library only.
+#include "../libtta.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace tta;
+
+//////////////////////// Constants and definitions //////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+#define TEST_RATE 44100 // sample rate of the signals
+#define TEST_THREADS 4 // worker threads of the parallel paths
+#define TEST_HEADER_SIZE 22 // TTA1 header with its crc
+
+#define FRAME_LENGTH(sps) (256 * (sps) / 245)
+
+static const uint32_t test_depths[] = { 2, 3 };
+static const uint32_t test_channels[] = { 1, 2, 6 };
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		failures++; \
+	} \
+} while (0)
+
+/////////////////////////////// Test streams ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// 'count' samples of 'nch' channels of PCM of 'depth' bytes: a few
+// partials over noise, so the frames differ in size
+static std::vector<uint8_t> make_pcm(uint32_t nch, uint32_t depth,
+	uint32_t count) {
+	std::vector<uint8_t> out((size_t) count * nch * depth);
+	std::mt19937 rng(12345);
+	int32_t peak = (1 << (depth * 8 - 2)) - 1;
+	uint8_t *p = out.data();
+	uint32_t i, ch, b;
+
+	for (i = 0; i < count; i++) {
+		for (ch = 0; ch < nch; ch++) {
+			double t = (double) i / TEST_RATE;
+			double x = 0.5 * sin(2 * M_PI * (220.0 + 55.0 * ch) * t) +
+				0.1 * ((double) rng() / 4294967296.0 - 0.5);
+			int32_t v = (int32_t)(x * peak);
+			for (b = 0; b < depth; b++)
+				*p++ = (uint8_t)(v >> (b * 8));
+		}
+	}
+
+	return out;
+} // make_pcm
+
+// encodes the PCM into a stream in memory, on 'threads' threads; a
+// 'blind' stream is encoded without the count of samples, in chunks, and
+// with the 'bound' of it if one is given
+static std::vector<uint8_t> encode(const std::vector<uint8_t> &pcm,
+	uint32_t nch, uint32_t depth, uint32_t sps, uint32_t threads,
+	bool blind = false, uint32_t bound = 0) {
+	std::vector<uint8_t> out(pcm.size() + pcm.size() / 2 + 65536);
+	uint32_t count = (uint32_t)(pcm.size() / (nch * depth));
+	info i = { FORMAT_SIMPLE, nch, depth * 8, sps, blind ? 0 : count };
+	encoder enc(std::span<uint8_t>(out.data(), out.size()));
+	size_t pos, len, chunk = (size_t) 1007 * nch * depth;
+
+	if (bound) enc.set_stream_length(bound);
+	enc.init(&i, 0, "");
+	if (blind) {
+		for (pos = 0; pos < pcm.size(); pos += len) {
+			len = (pcm.size() - pos < chunk) ? pcm.size() - pos : chunk;
+			enc.process_stream(std::span<const uint8_t>(pcm.data() + pos, len));
+		}
+	} else if (threads > 1) {
+		enc.process_stream_mt(std::span<const uint8_t>(pcm.data(), pcm.size()), threads);
+	} else enc.process_stream(std::span<const uint8_t>(pcm.data(), pcm.size()));
+	enc.finalize();
+
+	out.resize(enc.get_output_size());
+	return out;
+} // encode
+
+// decodes the whole stream on 'threads' threads
+static std::vector<uint8_t> decode(const std::vector<uint8_t> &tta,
+	uint32_t threads, info *i) {
+	decoder dec(std::span<const uint8_t>(tta.data(), tta.size()));
+	std::vector<uint8_t> out;
+	int ret;
+
+	dec.init(i, 0, "");
+	out.resize((size_t) i->samples * i->nch * (i->bps / 8));
+	if (threads > 1)
+		ret = dec.process_stream_mt(std::span<uint8_t>(out.data(), out.size()), threads);
+	else ret = dec.process_stream(std::span<uint8_t>(out.data(), out.size()));
+	if (ret != (int) i->samples) out.clear();
+
+	return out;
+} // decode
+
+// the positions of the frames from the seek table of a good stream
+static std::vector<uint64_t> frame_positions(const std::vector<uint8_t> &tta,
+	uint32_t frames) {
+	std::vector<uint64_t> pos(frames + 1);
+	const uint8_t *p = tta.data() + TEST_HEADER_SIZE;
+	uint32_t k;
+
+	pos[0] = TEST_HEADER_SIZE + (frames + 1) * 4;
+	for (k = 0; k < frames; k++, p += 4)
+		pos[k + 1] = pos[k] + (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+
+	return pos;
+} // frame_positions
+
+//////////////////////////////// Round trip /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// the serial and the frame-parallel paths give the same stream and the
+// same samples back
+static void test_roundtrip() {
+	for (uint32_t depth : test_depths)
+	for (uint32_t nch : test_channels) {
+		uint32_t count = FRAME_LENGTH(TEST_RATE) * 5 / 2;
+		std::vector<uint8_t> pcm = make_pcm(nch, depth, count);
+		std::vector<uint8_t> tta = encode(pcm, nch, depth, TEST_RATE, 1);
+		std::vector<uint8_t> tta_mt = encode(pcm, nch, depth, TEST_RATE, TEST_THREADS);
+		info i;
+
+		CHECK(tta == tta_mt, "roundtrip: %u ch %u bits: serial and mt streams differ",
+			nch, depth * 8);
+		CHECK(decode(tta, 1, &i) == pcm, "roundtrip: %u ch %u bits: serial decode mismatch",
+			nch, depth * 8);
+		CHECK(decode(tta, TEST_THREADS, &i) == pcm, "roundtrip: %u ch %u bits: mt decode mismatch",
+			nch, depth * 8);
+	}
+} // test_roundtrip
+
+/////////////////////////////// Range decode ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// the ranges at the frame boundaries, inside a frame and over the end
+// against the samples of the whole stream; in a stream with a corrupted
+// frame that frame is silence in both, also at the end of a range
+static void test_range() {
+	const uint32_t nch = 2, depth = 2, flen = FRAME_LENGTH(TEST_RATE);
+	const uint32_t count = flen * 6 + flen / 3;
+	const uint64_t ranges[][2] = {
+		{ 0, 100 }, { 0, flen }, { flen - 10, 20 }, { flen + 5, flen * 3 },
+		{ flen * 2, flen * 2 }, { count - 50, 100 }, { 0, count }, { 7, count },
+		{ flen * 4 + 10, 100 }, { flen * 3 + 10, flen }
+	};
+	std::vector<uint8_t> pcm = make_pcm(nch, depth, count);
+	std::vector<uint8_t> tta = encode(pcm, nch, depth, TEST_RATE, 1);
+	std::vector<uint64_t> pos = frame_positions(tta, 7);
+	uint32_t smp_size = nch * depth;
+
+	for (int corrupt = 0; corrupt < 2; corrupt++) {
+		std::vector<uint8_t> ref;
+		info i;
+
+		if (corrupt) tta[pos[4] + (pos[5] - pos[4]) / 2] ^= 0x08;
+		ref = decode(tta, 1, &i);
+		CHECK(ref.size() == pcm.size(), "range: %d: serial decode failed", corrupt);
+		if (ref.size() != pcm.size()) continue;
+
+		for (uint32_t threads : { 1U, (uint32_t) TEST_THREADS })
+		for (const uint64_t *r : ranges) {
+			decoder dec(std::span<const uint8_t>(tta.data(), tta.size()));
+			uint32_t len = (r[1] < count - r[0]) ? (uint32_t) r[1] : (uint32_t)(count - r[0]);
+			std::vector<uint8_t> out((size_t) r[1] * smp_size, 0xff);
+			int ret;
+
+			dec.init(&i, 0, "");
+			ret = dec.decode_range(r[0], (uint32_t) r[1], out.data(), threads);
+			CHECK(ret == (int) len && !memcmp(out.data(), ref.data() + r[0] * smp_size,
+				(size_t) len * smp_size), "range: %d: %u threads %llu+%llu: mismatch",
+				corrupt, threads, (unsigned long long) r[0], (unsigned long long) r[1]);
+
+			// the decoder goes on from the end of the range
+			if (r[0] + len < count) {
+				ret = dec.process_stream(out.data(), smp_size * 10);
+				CHECK(ret == 10 && !memcmp(out.data(), ref.data() + (r[0] + len) * smp_size,
+					smp_size * 10), "range: %d: %u threads %llu+%llu: mismatch after the range",
+					corrupt, threads, (unsigned long long) r[0], (unsigned long long) r[1]);
+			}
+		}
+	}
+} // test_range
+
+//////////////////////////// Seek table rebuild /////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// a stream with a broken seek table can't seek until the table is
+// rebuilt; the frames with a crc mismatch are counted and decoded as
+// silence, the others decode as before. The cases: a broken table, with
+// a corrupted frame in the middle or at the start, with a corrupted frame
+// and its table entry, and a stream cut in a frame, which is not rebuilt
+static void test_rebuild() {
+	const uint32_t nch = 2, depth = 2, sps = 11025, flen = FRAME_LENGTH(sps);
+	const uint32_t frames = 8, count = flen * frames - flen / 2;
+	const uint32_t smp_size = nch * depth;
+	std::vector<uint8_t> pcm = make_pcm(nch, depth, count);
+	std::vector<uint8_t> good = encode(pcm, nch, depth, sps, 1);
+	std::vector<uint64_t> pos = frame_positions(good, frames);
+	std::vector<uint8_t> out((size_t) count * smp_size);
+
+	for (int corrupt = 0; corrupt < 5; corrupt++) {
+		std::vector<uint8_t> tta = good;
+		uint32_t bad = 0, k, muted = frames;
+		uint32_t start = (corrupt == 4) ? flen * 2 + flen / 2 : flen / 2;
+		uint32_t last = (corrupt == 4) ? flen * 6 : count;
+		bool seek = true;
+		info i;
+		int ret;
+
+		tta[TEST_HEADER_SIZE + 4] ^= 0x10; // the size of frame 1
+		if (corrupt == 1) tta[pos[muted = 3] + (pos[4] - pos[3]) / 2] ^= 0x04;
+		if (corrupt == 2) tta[pos[muted = 5] + 5] ^= 0x40;
+		if (corrupt == 3) {
+			tta[pos[muted = 5] + 5] ^= 0x40;
+			tta[TEST_HEADER_SIZE + 5 * 4] ^= 0x01;
+		}
+		if (corrupt == 4) tta.resize(pos[6] + (pos[7] - pos[6]) / 2);
+
+		decoder dec(std::span<const uint8_t>(tta.data(), tta.size()));
+		dec.init(&i, 0, "");
+
+		// a part of the stream, before the rebuild
+		ret = dec.process_stream(out.data(), start * smp_size);
+		CHECK(ret == (int) start, "rebuild: %d: decode before the rebuild failed", corrupt);
+
+		try {
+			dec.seek_to_sample(flen);
+			seek = true;
+		} catch (tta::exception &ex) {
+			seek = (ex.error() != error::SEEK_FILE);
+		}
+		CHECK(!seek, "rebuild: %d: seek allowed with a broken table", corrupt);
+
+		CHECK(dec.rebuild_seek_table(&bad) == (corrupt != 4),
+			"rebuild: %d: table %srebuilt", corrupt, (corrupt == 4) ? "" : "not ");
+		CHECK(bad == ((muted < frames || corrupt == 4) ? 1U : 0U),
+			"rebuild: %d: %u bad frames", corrupt, bad);
+
+		// the decoder goes on where it was
+		ret = dec.process_stream(out.data() + (size_t) start * smp_size,
+			(last - start) * smp_size);
+		CHECK(ret == (int)(last - start), "rebuild: %d: decode after the rebuild failed",
+			corrupt);
+		for (k = 0; k < last / flen + (last % flen ? 1 : 0); k++) {
+			size_t at = (size_t) k * flen * smp_size;
+			size_t len = (size_t)((k == frames - 1) ? count - k * flen : flen) * smp_size;
+			if (k == muted) continue;
+			CHECK(!memcmp(out.data() + at, pcm.data() + at, len),
+				"rebuild: %d: frame %u: mismatch", corrupt, k);
+		}
+
+		// the rebuilt table finds the frames
+		if (corrupt == 4) continue;
+		ret = dec.decode_range(flen * 6 + 3, 100, out.data(), 1);
+		CHECK(ret == 100 && !memcmp(out.data(), pcm.data() + (size_t)(flen * 6 + 3) * smp_size,
+			100 * smp_size), "rebuild: %d: range mismatch", corrupt);
+	}
+} // test_rebuild
+
+////////////////////////////// Blind streams ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// a stream encoded without the count of samples decodes as the one
+// encoded with it, with the seek table written at finalize into the
+// space reserved for the default length or the bound given
+static void test_stream() {
+	for (uint32_t depth : test_depths)
+	for (uint32_t nch : test_channels)
+	for (uint32_t count : { 5U, (uint32_t) FRAME_LENGTH(TEST_RATE) * 3 + 17 })
+	for (uint32_t bound : { 0U, count, count * 2 }) {
+		std::vector<uint8_t> pcm = make_pcm(nch, depth, count);
+		std::vector<uint8_t> tta, out;
+		info i = {};
+
+		try {
+			tta = encode(pcm, nch, depth, TEST_RATE, 1, true, bound);
+			out = decode(tta, 1, &i);
+		} catch (tta::exception &ex) {
+			fprintf(stderr, "stream: %u ch %u bits %u samples bound %u: error %d\n",
+				nch, depth * 8, count, bound, (int) ex.error());
+		}
+		CHECK(i.samples == count && out == pcm,
+			"stream: %u ch %u bits %u samples bound %u: mismatch",
+			nch, depth * 8, count, bound);
+
+		// an exact bound leaves the id3v2 tag without padding
+		if (bound == count)
+			CHECK(tta.size() == encode(pcm, nch, depth, TEST_RATE, 1).size() + 27,
+				"stream: %u ch %u bits %u samples: %zu bytes with the exact bound",
+				nch, depth * 8, count, tta.size());
+	}
+
+	// a stream longer than its bound fails at finalize
+	for (uint32_t depth : test_depths) {
+		uint32_t count = FRAME_LENGTH(TEST_RATE) * 3 + 17;
+		std::vector<uint8_t> pcm = make_pcm(2, depth, count);
+		int err = -1;
+
+		try {
+			encode(pcm, 2, depth, TEST_RATE, 1, true, FRAME_LENGTH(TEST_RATE));
+		} catch (tta::exception &ex) {
+			err = (int) ex.error();
+		}
+		CHECK(err == (int) error::WRITE_FILE, "stream: %u bits: overflow gives %d",
+			depth * 8, err);
+	}
+} // test_stream
+
+////////////////////////////// 32-bit input /////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// 'int32' input out of the range of the depth is clamped to it, so the
+// stream decodes to the clamped values, interleaved or planar
+static void test_int32() {
+	const uint32_t count = 1000;
+
+	for (uint32_t depth : test_depths)
+	for (uint32_t nch : test_channels)
+	for (int planar = 0; planar < 2; planar++) {
+		int32_t lim = 1 << (depth * 8 - 1);
+		std::vector<int32_t> in((size_t) count * nch), want(in.size()), out(in.size());
+		std::vector<uint8_t> tta(in.size() * 4 + 65536);
+		std::mt19937 rng(depth * 10 + nch);
+		void *planes[8];
+		info i = { FORMAT_SIMPLE, nch, depth * 8, TEST_RATE, count };
+		uint32_t k, ch;
+		int ret;
+
+		for (k = 0; k < in.size(); k++) {
+			switch (rng() % 4) {
+			case 0: in[k] = (int32_t) rng(); break; // any 32-bit value
+			case 1: in[k] = (rng() & 1) ? lim : -lim - 1; break; // just out
+			default: in[k] = (int32_t)(rng() % (2U * lim)) - lim; break;
+			}
+			want[k] = (in[k] < -lim) ? -lim : (in[k] > lim - 1) ? lim - 1 : in[k];
+		}
+		if (planar) {
+			// the planes of the channels follow each other
+			std::vector<int32_t> tmp(in);
+			for (k = 0; k < count; k++)
+				for (ch = 0; ch < nch; ch++)
+					in[(size_t) ch * count + k] = tmp[(size_t) k * nch + ch];
+		}
+
+		encoder enc(std::span<uint8_t>(tta.data(), tta.size()));
+		enc.set_input_format(sample_format::int32);
+		enc.init(&i, 0, "");
+		if (planar) {
+			for (ch = 0; ch < nch; ch++)
+				planes[ch] = in.data() + (size_t) ch * count;
+			enc.process_stream_planar(planes, count);
+		} else enc.process_stream(std::span<const uint8_t>((const uint8_t *) in.data(),
+			in.size() * 4));
+		enc.finalize();
+
+		decoder dec(std::span<const uint8_t>(tta.data(), enc.get_output_size()));
+		dec.set_output_format(sample_format::int32);
+		dec.init(&i, 0, "");
+		ret = dec.process_stream(std::span<uint8_t>((uint8_t *) out.data(), out.size() * 4));
+		CHECK(ret == (int) count && out == want, "int32: %u ch %u bits%s: mismatch",
+			nch, depth * 8, planar ? " planar" : "");
+	}
+} // test_int32
+
+/////////////////////////////////// Main ////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+
+static const struct {
+	const char *name;
+	void (*run)();
+} tests[] = {
+	{ "roundtrip", test_roundtrip },
+	{ "range", test_range },
+	{ "rebuild", test_rebuild },
+	{ "stream", test_stream },
+	{ "int32", test_int32 }
+};
+
+int main(int argc, char **argv) {
+	int i, n, run = 0;
+
+	for (i = 1; i < argc; i++) {
+		for (n = 0; n < (int)(sizeof(tests) / sizeof(tests[0])); n++) {
+			if (strcmp(argv[i], tests[n].name)) continue;
+			try {
+				tests[n].run();
+			} catch (tta::exception &ex) {
+				fprintf(stderr, "%s: error %d\n", tests[n].name, (int) ex.error());
+				failures++;
+			}
+			run++;
+		}
+	}
+
+	if (!run) {
+		fprintf(stderr, "usage: tta_test name...\n\n  name:");
+		for (n = 0; n < (int)(sizeof(tests) / sizeof(tests[0])); n++)
+			fprintf(stderr, " %s", tests[n].name);
+		fprintf(stderr, "\n\n");
+		return 1;
+	}
+
+	return failures ? 1 : 0;
+} // main
+
+/* eof */